@@ -1,8 +1,14 @@
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -10,6 +16,187 @@
 
 #include "circleDetector.h"
 
+#ifndef CD_MAX_THREADS
+#define CD_MAX_THREADS 64
+#endif
+
+// Circle refinement: Gauss-Newton iterations after the algebraic seed, and the
+// weakest luma step (grey levels per half pixel) accepted as an edge.
+#ifndef CD_REFINE_GN_STEPS
+#define CD_REFINE_GN_STEPS 5
+#endif
+#ifndef CD_REFINE_MIN_EDGE
+#define CD_REFINE_MIN_EDGE 4.0
+#endif
+
+// Most circles one merged component may be split into, and how far the radius
+// of a split part may stray from its seed's inscribed radius (a fraction of it).
+#ifndef CD_SPLIT_MAX_PARTS
+#define CD_SPLIT_MAX_PARTS 16
+#endif
+#ifndef CD_SPLIT_RADIUS_TOL
+#define CD_SPLIT_RADIUS_TOL 0.2
+#endif
+
+// Kernels the fixed-configuration entry points instantiate with literal
+// arguments; forcing them inline lets constant widths and flags fold away.
+#if defined(__GNUC__)
+#define CD_KERNEL static inline __attribute__((always_inline))
+#else
+#define CD_KERNEL static inline
+#endif
+
+// Library-owned worker pool. Started lazily on the first call that wants more
+// than one thread, with one worker per extra online core; the calling thread
+// always takes part in the work, so a single-core machine runs everything
+// inline. The workers are joined when the library is unloaded or the process
+// exits (GCC/Clang destructor); no detection may be running at that point.
+typedef void (*cd_task_fn)(void* arg, int task);
+
+typedef struct {
+        pthread_mutex_t lock;
+        pthread_cond_t  wake;
+        pthread_cond_t  done;
+        pthread_mutex_t submit; // one job at a time, other callers run inline
+        int             num_workers;
+        unsigned        generation;
+        cd_task_fn      fn;
+        void*           arg;
+        int             num_tasks;
+        int             next_task;
+        int             slots;   // workers still allowed to join the current job
+        int             running; // workers currently inside the current job
+        int             stop;    // set once by pool_shutdown
+} CDThreadPool;
+
+static CDThreadPool   g_pool = {PTHREAD_MUTEX_INITIALIZER,
+                                 PTHREAD_COND_INITIALIZER,
+                                 PTHREAD_COND_INITIALIZER,
+                                 PTHREAD_MUTEX_INITIALIZER,
+                                 0,
+                                 0,
+                                 NULL,
+                                 NULL,
+                                 0,
+                                 0,
+                                 0,
+                                 0,
+                                 0};
+static pthread_once_t g_pool_once = PTHREAD_ONCE_INIT;
+static pthread_t      g_pool_workers[CD_MAX_THREADS];
+
+static void pool_drain(CDThreadPool* pool) {
+        for (;;) {
+                pthread_mutex_lock(&pool->lock);
+                const int task = pool->next_task < pool->num_tasks ? pool->next_task++ : -1;
+                pthread_mutex_unlock(&pool->lock);
+                if (task < 0) return;
+                pool->fn(pool->arg, task);
+        }
+}
+
+static void* pool_worker(void* unused) {
+        (void)unused;
+        CDThreadPool* pool = &g_pool;
+        unsigned      seen = 0;
+        for (;;) {
+                pthread_mutex_lock(&pool->lock);
+                while (pool->generation == seen && !pool->stop) pthread_cond_wait(&pool->wake, &pool->lock);
+                if (pool->stop) {
+                        pthread_mutex_unlock(&pool->lock);
+                        return NULL;
+                }
+                seen = pool->generation;
+                if (pool->slots <= 0) {
+                        pthread_mutex_unlock(&pool->lock);
+                        continue;
+                }
+                pool->slots--;
+                pool->running++;
+                pthread_mutex_unlock(&pool->lock);
+
+                pool_drain(pool);
+
+                pthread_mutex_lock(&pool->lock);
+                if (--pool->running == 0) pthread_cond_signal(&pool->done);
+                pthread_mutex_unlock(&pool->lock);
+        }
+        return NULL;
+}
+
+static void pool_init(void) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cores > CD_MAX_THREADS) cores = CD_MAX_THREADS;
+        int started = 0;
+        for (long i = 1; i < cores; ++i) {
+                if (pthread_create(&g_pool_workers[started], NULL, pool_worker, NULL) == 0) ++started;
+        }
+        g_pool.num_workers = started;
+}
+
+// Stops and joins the workers, so unloading the library (dlclose) does not
+// leave threads running its code.
+#if defined(__GNUC__)
+__attribute__((destructor))
+#endif
+static void pool_shutdown(void) {
+        CDThreadPool* pool = &g_pool;
+        if (pool->num_workers == 0) return;
+        pthread_mutex_lock(&pool->lock);
+        pool->stop = 1;
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+        for (int i = 0; i < pool->num_workers; ++i) pthread_join(g_pool_workers[i], NULL);
+        pool->num_workers = 0;
+}
+
+// Number of threads a parallel stage may use for a given config value
+// (0 = every core, 1 = serial). Serial callers never start the pool.
+static int pool_threads(int requested) {
+        if (requested == 1) return 1;
+        pthread_once(&g_pool_once, pool_init);
+        const int avail = g_pool.num_workers + 1;
+        if (requested <= 0 || requested > avail) return avail;
+        return requested;
+}
+
+// Runs fn(arg, 0..num_tasks-1) on up to max_threads threads and returns once
+// every task has finished, so consecutive calls act as barriers.
+static void pool_run(cd_task_fn fn, void* arg, int num_tasks, int max_threads) {
+        CDThreadPool* pool = &g_pool;
+        if (num_tasks > 1 && max_threads > 1) pthread_once(&g_pool_once, pool_init);
+        if (num_tasks <= 1 || max_threads <= 1 || pool->num_workers == 0 || pthread_mutex_trylock(&pool->submit) != 0) {
+                for (int t = 0; t < num_tasks; ++t) fn(arg, t);
+                return;
+        }
+        pthread_mutex_lock(&pool->lock);
+        pool->fn        = fn;
+        pool->arg       = arg;
+        pool->num_tasks = num_tasks;
+        pool->next_task = 0;
+        pool->slots     = max_threads - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_drain(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->slots = 0;
+        while (pool->running > 0) pthread_cond_wait(&pool->done, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+        pthread_mutex_unlock(&pool->submit);
+}
+
+// Per-core L2 size used to size row bands, with a conservative fallback.
+static size_t l2_cache_bytes(void) {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+        const long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        if (l2 > 0) return (size_t)l2;
+#endif
+        return 256u * 1024u;
+}
+
 
 static inline uint8_t clamp_u8(int v) {
         if (v < 0) return 0;
@@ -22,123 +209,879 @@ static inline uint8_t abs_u8_diff(uint8_t a, uint8_t b) {
         return (uint8_t)((a > b) ? (a - b) : (b - a));
 }
 
-static void make_color_mask_i420_full(const uint8_t* restrict y,
-                                      const uint8_t* restrict u,
-                                      const uint8_t* restrict v,
-                                      int     width,
-                                      int     height,
-                                      uint8_t target_u,
-                                      uint8_t target_v,
-                                      uint8_t uv_tol,
-                                      uint8_t y_min,
-                                      uint8_t* restrict mask) {
-        const int hw = width >> 1;
-        for (int j = 0; j < height; ++j) {
-                const uint8_t* up   = u + (j >> 1) * hw;
-                const uint8_t* vp   = v + (j >> 1) * hw;
-                const uint8_t* yrow = y + j * width;
-                uint8_t*       dst  = mask + j * width;
-                int            i    = 0;
-                for (; i + 16 <= width; i += 16) {
-                        uint8_t mvec[16];
-                        for (int k = 0; k < 16; ++k) {
-                                const int     x  = i + k;
-                                const uint8_t uu = up[x >> 1];
-                                const uint8_t vv = vp[x >> 1];
-                                uint8_t       ok = ((int)abs_u8_diff(uu, target_u) <= uv_tol) &
-                                             (int)(abs_u8_diff(vv, target_v) <= uv_tol);
-                                if (ok && y_min) {
-                                        ok &= (yrow[x] >= y_min);
-                                }
-                                mvec[k] = ok ? 255u : 0u;
-                        }
-                        memcpy(dst + i, mvec, 16);
-                }
-                for (; i < width; ++i) {
-                        const uint8_t uu = up[i >> 1];
-                        const uint8_t vv = vp[i >> 1];
-                        uint8_t       ok =
-                            ((int)abs_u8_diff(uu, target_u) <= uv_tol) & (int)(abs_u8_diff(vv, target_v) <= uv_tol);
-                        if (ok && y_min) {
-                                ok &= (yrow[i] >= y_min);
-                        }
-                        dst[i] = ok ? 255u : 0u;
-                }
-        }
-}
-
-static void erode3x3_cross(const uint8_t* restrict src, int w, int h, uint8_t* restrict dst) {
-        for (int y = 0; y < h; ++y) {
-                const int yw  = y * w;
-                const int ym1 = (y - 1) * w;
-                const int yp1 = (y + 1) * w;
-                for (int x = 0; x < w; ++x) {
-                        const int idx = yw + x;
-                        if (x == 0 || y == 0 || x == w - 1 || y == h - 1) {
-                                dst[idx] = 0;
-                                continue;
-                        }
-                        uint8_t m   = src[idx];
-                        uint8_t val = src[idx - 1];
-                        if (val < m) m = val;
-                        val = src[idx + 1];
-                        if (val < m) m = val;
-                        val = src[ym1 + x];
-                        if (val < m) m = val;
-                        val = src[yp1 + x];
-                        if (val < m) m = val;
-                        dst[idx] = m;
+// Mask values: CD_MASK_STRICT for pixels within uv_tol_strict, CD_MASK_LOOSE
+// for the rest of uv_tol. Without hysteresis uv_tol_strict equals uv_tol and
+// every foreground pixel is strict, as before.
+//
+// Every input is thresholded the same way: one decision per chroma sample,
+// made once per chroma row, then widened to the luma rows it covers with the
+// per-pixel y_min test.
+#define CD_MASK_STRICT 255u
+#define CD_MASK_LOOSE  1u
+
+static int is_high_depth(int input_format) {
+        return input_format == CD_INPUT_I420_16 || input_format == CD_INPUT_P016;
+}
+
+// Threshold parameters of a 16-bit input at its bit depth.
+typedef struct {
+        int      shift; // bit_depth - 8: drops samples to 8 bits for region tables and classes
+        uint16_t target_u;
+        uint16_t target_v;
+        uint16_t uv_tol;
+        uint16_t uv_tol_strict;
+        uint16_t y_min;
+} Thresh16;
+
+// Full-precision *16 fields when uv_tol16 is set, else the 8-bit ones scaled
+// up to the bit depth.
+static void thresh16_params(const CDConfig* cfg, Thresh16* p) {
+        const int depth = cfg->input_format == CD_INPUT_P016 ? 16 : cfg->bit_depth ? cfg->bit_depth : 10;
+        p->shift        = depth < 8 ? 0 : depth > 16 ? 8 : depth - 8;
+        if (cfg->uv_tol16) {
+                p->target_u = cfg->target_u16;
+                p->target_v = cfg->target_v16;
+                p->uv_tol   = cfg->uv_tol16;
+                p->y_min    = cfg->y_min16;
+        } else {
+                p->target_u = (uint16_t)(cfg->target_u << p->shift);
+                p->target_v = (uint16_t)(cfg->target_v << p->shift);
+                p->uv_tol   = (uint16_t)(cfg->uv_tol << p->shift);
+                p->y_min    = (uint16_t)(cfg->y_min << p->shift);
+        }
+        p->uv_tol_strict = cfg->uv_tol_strict16 ? cfg->uv_tol_strict16
+                           : cfg->uv_tol_strict ? (uint16_t)(cfg->uv_tol_strict << p->shift)
+                                                : p->uv_tol;
+}
+
+// CDConfig fields a UV region table is built from. Zeroed before filling so
+// it can be compared with memcmp.
+typedef struct {
+        int     region;
+        uint8_t target_u;
+        uint8_t target_v;
+        uint8_t uv_tol_strict;
+        float   axes[2];
+        float   angle;
+        float   hue[2];
+        float   sat[2];
+        int     polygon_count;
+} UVRegionKey;
+
+// Chroma decision for non-box regions: bit (u & 7) of byte v * 32 + u / 8 is
+// set when (u, v) is inside. 8 KB per bitmap, so lookups stay in L1.
+typedef struct {
+        UVRegionKey key;
+        uint8_t     loose[256 * 32];
+        uint8_t     strict[256 * 32]; // hysteresis seeds, equal to loose when off
+} UVTable;
+
+static void uv_region_key(const CDConfig* cfg, UVRegionKey* key) {
+        memset(key, 0, sizeof(*key));
+        key->region        = cfg->uv_region;
+        key->target_u      = cfg->target_u;
+        key->target_v      = cfg->target_v;
+        key->uv_tol_strict = cfg->uv_tol_strict;
+        if (is_high_depth(cfg->input_format) && cfg->uv_tol_strict16) {
+                // The table sees the top 8 bits of 16-bit chroma, so the seed
+                // tolerance drops to those units; at least 1 keeps it on.
+                Thresh16 p;
+                thresh16_params(cfg, &p);
+                const int tol      = p.uv_tol_strict >> p.shift;
+                key->uv_tol_strict = (uint8_t)(tol < 1 ? 1 : tol > UINT8_MAX ? UINT8_MAX : tol);
+        }
+        key->polygon_count = cfg->uv_polygon ? cfg->uv_polygon_count : 0;
+        switch (cfg->uv_region) {
+                case CD_UV_ELLIPSE:
+                        key->axes[0] = cfg->uv_axes[0];
+                        key->axes[1] = cfg->uv_axes[1];
+                        key->angle   = cfg->uv_angle;
+                        break;
+                case CD_UV_WEDGE:
+                        key->hue[0] = cfg->uv_hue[0];
+                        key->hue[1] = cfg->uv_hue[1];
+                        key->sat[0] = cfg->uv_sat[0];
+                        key->sat[1] = cfg->uv_sat[1];
+                        break;
+        }
+}
+
+// Angle folded into [0, 2pi).
+static double wrap_angle(double a) {
+        a = fmod(a, 2.0 * M_PI);
+        return a < 0.0 ? a + 2.0 * M_PI : a;
+}
+
+// Even-odd crossing test of the point (u, v) against the polygon.
+static int uv_in_polygon(const CDPoint* pts, int count, int u, int v) {
+        int inside = 0;
+        for (int i = 0, j = count - 1; i < count; j = i++) {
+                if ((pts[i].y > v) == (pts[j].y > v)) continue;
+                const double x =
+                    pts[j].x + (double)(v - pts[j].y) * (pts[i].x - pts[j].x) / (double)(pts[i].y - pts[j].y);
+                if (u < x) inside = !inside;
+        }
+        return inside;
+}
+
+// Whether the chroma sample (u, v) lies in the region of key.
+static int uv_in_region(const UVRegionKey* key, const CDPoint* polygon, int u, int v) {
+        switch (key->region) {
+                case CD_UV_ELLIPSE: {
+                        if (key->axes[0] <= 0.0f || key->axes[1] <= 0.0f) return 0;
+                        const double du = u - key->target_u;
+                        const double dv = v - key->target_v;
+                        const double a  = (du * cos(key->angle) + dv * sin(key->angle)) / key->axes[0];
+                        const double b  = (dv * cos(key->angle) - du * sin(key->angle)) / key->axes[1];
+                        return a * a + b * b <= 1.0;
+                }
+                case CD_UV_WEDGE: {
+                        const double du = u - 128;
+                        const double dv = v - 128;
+                        const double r  = sqrt(du * du + dv * dv);
+                        if (r < key->sat[0] || (key->sat[1] > 0.0f && r > key->sat[1])) return 0;
+                        return wrap_angle(atan2(dv, du) - key->hue[0]) <= wrap_angle((double)key->hue[1] - key->hue[0]);
                 }
+                case CD_UV_POLYGON: return key->polygon_count >= 3 && uv_in_polygon(polygon, key->polygon_count, u, v);
+                default: return 0;
         }
 }
 
-static void dilate3x3_cross(const uint8_t* restrict src, int w, int h, uint8_t* restrict dst) {
-        for (int y = 0; y < h; ++y) {
-                const int yw  = y * w;
-                const int ym1 = (y - 1) * w;
-                const int yp1 = (y + 1) * w;
-                for (int x = 0; x < w; ++x) {
-                        const int idx = yw + x;
-                        uint8_t   m   = src[idx];
-                        if (x > 0) {
-                                uint8_t val = src[idx - 1];
-                                if (val > m) m = val;
-                        }
-                        if (x + 1 < w) {
-                                uint8_t val = src[idx + 1];
-                                if (val > m) m = val;
+// Rasterises the region of key into t. Without hysteresis the strict bitmap
+// is a copy; with it the seeds are the region pixels within uv_tol_strict of
+// the target on both axes, like the box test.
+static void uv_table_build(UVTable* t, const UVRegionKey* key, const CDPoint* polygon) {
+        memset(t->loose, 0, sizeof(t->loose));
+        memset(t->strict, 0, sizeof(t->strict));
+        for (int v = 0; v < 256; ++v) {
+                for (int u = 0; u < 256; ++u) {
+                        if (!uv_in_region(key, polygon, u, v)) continue;
+                        const uint8_t bit = (uint8_t)(1u << (u & 7));
+                        t->loose[(v << 5) | (u >> 3)] |= bit;
+                        if (!key->uv_tol_strict || (abs_u8_diff((uint8_t)u, key->target_u) <= key->uv_tol_strict &&
+                                                    abs_u8_diff((uint8_t)v, key->target_v) <= key->uv_tol_strict))
+                                t->strict[(v << 5) | (u >> 3)] |= bit;
+                }
+        }
+}
+
+// Table decision for one chroma row: 0, CD_MASK_LOOSE or CD_MASK_STRICT per
+// sample. Done once per chroma row and shared by the two luma rows below it.
+static void uv_table_row(const UVTable* t,
+                         const uint8_t* restrict up,
+                         const uint8_t* restrict vp,
+                         int n,
+                         uint8_t* restrict dst) {
+        for (int i = 0; i < n; ++i) {
+                const int idx    = (vp[i] << 5) | (up[i] >> 3);
+                const int bit    = up[i] & 7;
+                const int in     = (t->loose[idx] >> bit) & 1;
+                const int strict = (t->strict[idx] >> bit) & 1;
+                dst[i]           = !in ? 0u : strict ? CD_MASK_STRICT : CD_MASK_LOOSE;
+        }
+}
+
+// Widens a chroma decision row to full resolution and applies y_min. With
+// shift_x = 0 (4:4:4) the samples are already per pixel and only masked.
+CD_KERNEL void expand_chroma_row(const uint8_t* restrict chroma,
+                                const uint8_t* restrict yrow,
+                                int     width,
+                                int     shift_x,
+                                uint8_t y_min,
+                                uint8_t* restrict dst) {
+        int x = 0;
+#if defined(__SSE2__)
+        const __m128i vmin = _mm_set1_epi8((char)y_min);
+        if (shift_x) {
+                for (; x + 32 <= width; x += 32) {
+                        const __m128i c  = _mm_loadu_si128((const __m128i*)(chroma + (x >> 1)));
+                        __m128i       lo = _mm_unpacklo_epi8(c, c);
+                        __m128i       hi = _mm_unpackhi_epi8(c, c);
+                        if (y_min) {
+                                const __m128i y0 = _mm_loadu_si128((const __m128i*)(yrow + x));
+                                const __m128i y1 = _mm_loadu_si128((const __m128i*)(yrow + x + 16));
+                                lo               = _mm_and_si128(lo, _mm_cmpeq_epi8(_mm_max_epu8(y0, vmin), y0));
+                                hi               = _mm_and_si128(hi, _mm_cmpeq_epi8(_mm_max_epu8(y1, vmin), y1));
                         }
-                        if (y > 0) {
-                                uint8_t val = src[ym1 + x];
-                                if (val > m) m = val;
+                        _mm_storeu_si128((__m128i*)(dst + x), lo);
+                        _mm_storeu_si128((__m128i*)(dst + x + 16), hi);
+                }
+        } else {
+                for (; x + 16 <= width; x += 16) {
+                        __m128i c = _mm_loadu_si128((const __m128i*)(chroma + x));
+                        if (y_min) {
+                                const __m128i y = _mm_loadu_si128((const __m128i*)(yrow + x));
+                                c               = _mm_and_si128(c, _mm_cmpeq_epi8(_mm_max_epu8(y, vmin), y));
                         }
-                        if (y + 1 < h) {
-                                uint8_t val = src[yp1 + x];
-                                if (val > m) m = val;
+                        _mm_storeu_si128((__m128i*)(dst + x), c);
+                }
+        }
+#endif
+        for (; x < width; ++x) dst[x] = yrow[x] >= y_min ? chroma[x >> shift_x] : 0u;
+}
+
+// Hysteresis is off in multi-class calls, whose mask bits are class ids.
+static int hysteresis_on(const CDConfig* cfg) {
+        return (cfg->uv_tol_strict || cfg->uv_tol_strict16) && cfg->num_classes <= 0;
+}
+
+static int num_color_classes(const CDConfig* cfg) {
+        if (!cfg->classes || cfg->num_classes <= 0) return 0;
+        return cfg->num_classes < CD_MAX_CLASSES ? cfg->num_classes : CD_MAX_CLASSES;
+}
+
+// Class decision for one chroma row: 1 << k for the first class k whose box
+// holds the sample, 0 for none. Shared by the two luma rows below it.
+static void class_row(const CDColorClass* classes,
+                      int                 num_classes,
+                      const uint8_t* restrict up,
+                      const uint8_t* restrict vp,
+                      int n,
+                      uint8_t* restrict dst) {
+        for (int i = 0; i < n; ++i) {
+                uint8_t m = 0;
+                for (int k = num_classes - 1; k >= 0; --k) {
+                        const int in = abs_u8_diff(up[i], classes[k].target_u) <= classes[k].uv_tol &&
+                                       abs_u8_diff(vp[i], classes[k].target_v) <= classes[k].uv_tol;
+                        if (in) m = (uint8_t)(1u << k);
+                }
+                dst[i] = m;
+        }
+}
+
+// Box test on one chroma row.
+CD_KERNEL void box_row(const uint8_t* restrict up,
+                       const uint8_t* restrict vp,
+                       int     n,
+                       uint8_t target_u,
+                       uint8_t target_v,
+                       uint8_t uv_tol,
+                       uint8_t uv_tol_strict,
+                       uint8_t* restrict dst) {
+        int i = 0;
+#if defined(__SSE2__)
+        const __m128i tu   = _mm_set1_epi8((char)target_u);
+        const __m128i tv   = _mm_set1_epi8((char)target_v);
+        const __m128i tol  = _mm_set1_epi8((char)uv_tol);
+        const __m128i stol = _mm_set1_epi8((char)uv_tol_strict);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one  = _mm_set1_epi8(1);
+        for (; i + 16 <= n; i += 16) {
+                const __m128i u  = _mm_loadu_si128((const __m128i*)(up + i));
+                const __m128i v  = _mm_loadu_si128((const __m128i*)(vp + i));
+                const __m128i du = _mm_or_si128(_mm_subs_epu8(u, tu), _mm_subs_epu8(tu, u));
+                const __m128i dv = _mm_or_si128(_mm_subs_epu8(v, tv), _mm_subs_epu8(tv, v));
+                // d <= tol exactly when the saturating d - tol is zero.
+                const __m128i ok = _mm_cmpeq_epi8(_mm_or_si128(_mm_subs_epu8(du, tol), _mm_subs_epu8(dv, tol)), zero);
+                const __m128i st =
+                    _mm_cmpeq_epi8(_mm_or_si128(_mm_subs_epu8(du, stol), _mm_subs_epu8(dv, stol)), zero);
+                _mm_storeu_si128((__m128i*)(dst + i), _mm_and_si128(ok, _mm_or_si128(st, one)));
+        }
+#endif
+        for (; i < n; ++i) {
+                const uint8_t du     = abs_u8_diff(up[i], target_u);
+                const uint8_t dv     = abs_u8_diff(vp[i], target_v);
+                const int     ok     = (du <= uv_tol) & (dv <= uv_tol);
+                const int     strict = (du <= uv_tol_strict) & (dv <= uv_tol_strict);
+                dst[i]               = !ok ? 0u : strict ? CD_MASK_STRICT : CD_MASK_LOOSE;
+        }
+}
+
+// Chroma decision of one row of 8-bit U/V samples by classes, region table or
+// box, in the mask encoding of the call.
+static void decide_chroma_row(const CDConfig* cfg,
+                              const UVTable*  uv,
+                              int             num_classes,
+                              const uint8_t* restrict up,
+                              const uint8_t* restrict vp,
+                              int n,
+                              uint8_t* restrict dst) {
+        if (num_classes) {
+                class_row(cfg->classes, num_classes, up, vp, n, dst);
+        } else if (uv) {
+                uv_table_row(uv, up, vp, n, dst);
+        } else {
+                const uint8_t strict = cfg->uv_tol_strict ? cfg->uv_tol_strict : cfg->uv_tol;
+                box_row(up, vp, n, cfg->target_u, cfg->target_v, cfg->uv_tol, strict, dst);
+        }
+}
+
+// Sample offsets inside a 2x2 Bayer quad: R at (rx, ry), B diagonally
+// opposite, the two G on the other diagonal.
+static void bayer_layout(int input_format, int* rx, int* ry) {
+        *rx = input_format == CD_INPUT_BAYER_BGGR || input_format == CD_INPUT_BAYER_GRBG;
+        *ry = input_format == CD_INPUT_BAYER_BGGR || input_format == CD_INPUT_BAYER_GBRG;
+}
+
+// Chroma decision for quad row jq of a Bayer mosaic in cfg->y. Each 2x2 quad
+// becomes one full-range BT.601 Y/U/V sample, like one I420 chroma sample
+// and its luma block, and goes through the same box, region table or
+// class test; y_min applies to the quad luma. scratch holds 3 * width / 2.
+static void bayer_chroma_row(const CDConfig* cfg,
+                             const UVTable*  uv,
+                             int             num_classes,
+                             int             jq,
+                             uint8_t* restrict scratch,
+                             uint8_t* restrict dst) {
+        const int      hw = cfg->width >> 1;
+        const uint8_t* r0 = cfg->y + (size_t)(2 * jq) * cfg->width;
+        uint8_t*       qu = scratch;
+        uint8_t*       qv = scratch + hw;
+        uint8_t*       qy = scratch + 2 * hw;
+        int            rx;
+        int            ry;
+        bayer_layout(cfg->input_format, &rx, &ry);
+        // R and one G share row ry of the quad, B and the other G the other row.
+        const uint8_t* rrow = ry ? r0 + cfg->width : r0;
+        const uint8_t* brow = ry ? r0 : r0 + cfg->width;
+        for (int i = 0; i < hw; ++i) {
+                const int r = rrow[2 * i + rx];
+                const int b = brow[2 * i + 1 - rx];
+                const int g = (rrow[2 * i + 1 - rx] + brow[2 * i + rx] + 1) >> 1;
+                qy[i]       = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+                qu[i]       = clamp_u8((-43 * r - 85 * g + 128 * b + 32896) >> 8);
+                qv[i]       = clamp_u8((128 * r - 107 * g - 21 * b + 32896) >> 8);
+        }
+        decide_chroma_row(cfg, uv, num_classes, qu, qv, hw, dst);
+        if (cfg->y_min) {
+                for (int i = 0; i < hw; ++i) dst[i] = qy[i] >= cfg->y_min ? dst[i] : 0u;
+        }
+}
+
+static int is_bayer(int input_format) {
+        return input_format >= CD_INPUT_BAYER_RGGB && input_format <= CD_INPUT_BAYER_GBRG;
+}
+
+static inline uint16_t abs_u16_diff(uint16_t a, uint16_t b) {
+        return (uint16_t)((a > b) ? (a - b) : (b - a));
+}
+
+// Box test on 16-bit chroma, in the 0 / CD_MASK_LOOSE / CD_MASK_STRICT encoding.
+static void box_row16(const uint16_t* restrict up,
+                      const uint16_t* restrict vp,
+                      int             n,
+                      const Thresh16* p,
+                      uint8_t* restrict dst) {
+        int i = 0;
+#if defined(__SSE2__)
+        const __m128i tu   = _mm_set1_epi16((short)p->target_u);
+        const __m128i tv   = _mm_set1_epi16((short)p->target_v);
+        const __m128i tol  = _mm_set1_epi16((short)p->uv_tol);
+        const __m128i stol = _mm_set1_epi16((short)p->uv_tol_strict);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one  = _mm_set1_epi8(1);
+        for (; i + 16 <= n; i += 16) {
+                __m128i ok[2];
+                __m128i st[2];
+                for (int h = 0; h < 2; ++h) {
+                        const __m128i u  = _mm_loadu_si128((const __m128i*)(up + i + 8 * h));
+                        const __m128i v  = _mm_loadu_si128((const __m128i*)(vp + i + 8 * h));
+                        const __m128i du = _mm_or_si128(_mm_subs_epu16(u, tu), _mm_subs_epu16(tu, u));
+                        const __m128i dv = _mm_or_si128(_mm_subs_epu16(v, tv), _mm_subs_epu16(tv, v));
+                        // d <= tol exactly when the saturating d - tol is zero.
+                        ok[h] = _mm_and_si128(_mm_cmpeq_epi16(_mm_subs_epu16(du, tol), zero),
+                                              _mm_cmpeq_epi16(_mm_subs_epu16(dv, tol), zero));
+                        st[h] = _mm_and_si128(_mm_cmpeq_epi16(_mm_subs_epu16(du, stol), zero),
+                                              _mm_cmpeq_epi16(_mm_subs_epu16(dv, stol), zero));
+                }
+                const __m128i okb = _mm_packs_epi16(ok[0], ok[1]);
+                const __m128i stb = _mm_packs_epi16(st[0], st[1]);
+                _mm_storeu_si128((__m128i*)(dst + i), _mm_and_si128(okb, _mm_or_si128(stb, one)));
+        }
+#endif
+        for (; i < n; ++i) {
+                const uint16_t du     = abs_u16_diff(up[i], p->target_u);
+                const uint16_t dv     = abs_u16_diff(vp[i], p->target_v);
+                const int      ok     = (du <= p->uv_tol) & (dv <= p->uv_tol);
+                const int      strict = (du <= p->uv_tol_strict) & (dv <= p->uv_tol_strict);
+                dst[i]                = !ok ? 0u : strict ? CD_MASK_STRICT : CD_MASK_LOOSE;
+        }
+}
+
+// 16-bit counterpart of expand_chroma_row: y_min is tested on 16-bit luma.
+static void expand_chroma_row16(const uint8_t* restrict chroma,
+                                const uint16_t* restrict yrow,
+                                int      width,
+                                int      shift_x,
+                                uint16_t y_min,
+                                uint8_t* restrict dst) {
+        int x = 0;
+#if defined(__SSE2__)
+        const __m128i vmin = _mm_set1_epi16((short)y_min);
+        const __m128i zero = _mm_setzero_si128();
+        if (shift_x) {
+                for (; x + 32 <= width; x += 32) {
+                        const __m128i c = _mm_loadu_si128((const __m128i*)(chroma + (x >> 1)));
+                        __m128i       k[4];
+                        for (int q = 0; q < 4; ++q) {
+                                const __m128i y = _mm_loadu_si128((const __m128i*)(yrow + x + 8 * q));
+                                k[q]            = _mm_cmpeq_epi16(_mm_subs_epu16(vmin, y), zero);
                         }
-                        dst[idx] = m;
+                        const __m128i lo = _mm_and_si128(_mm_unpacklo_epi8(c, c), _mm_packs_epi16(k[0], k[1]));
+                        const __m128i hi = _mm_and_si128(_mm_unpackhi_epi8(c, c), _mm_packs_epi16(k[2], k[3]));
+                        _mm_storeu_si128((__m128i*)(dst + x), lo);
+                        _mm_storeu_si128((__m128i*)(dst + x + 16), hi);
+                }
+        } else {
+                for (; x + 16 <= width; x += 16) {
+                        const __m128i c  = _mm_loadu_si128((const __m128i*)(chroma + x));
+                        const __m128i y0 = _mm_loadu_si128((const __m128i*)(yrow + x));
+                        const __m128i y1 = _mm_loadu_si128((const __m128i*)(yrow + x + 8));
+                        const __m128i k0 = _mm_cmpeq_epi16(_mm_subs_epu16(vmin, y0), zero);
+                        const __m128i k1 = _mm_cmpeq_epi16(_mm_subs_epu16(vmin, y1), zero);
+                        _mm_storeu_si128((__m128i*)(dst + x), _mm_and_si128(c, _mm_packs_epi16(k0, k1)));
                 }
         }
+#endif
+        for (; x < width; ++x) dst[x] = yrow[x] >= y_min ? chroma[x >> shift_x] : 0u;
 }
 
-static void
-morph_open_close_3x3(uint8_t* restrict img, int width, int height, uint8_t* restrict tmp1, uint8_t* restrict tmp2) {
+// Chroma decision for the cw samples of chroma row jc of a 16-bit input. The
+// box test runs at full precision; region tables and classes see the top 8
+// bits. scratch holds 6 * cw bytes, 2-byte aligned.
+static void chroma16_row(const CDConfig* cfg,
+                         const UVTable*  uv,
+                         int             num_classes,
+                         const Thresh16* p,
+                         int             jc,
+                         int             cw,
+                         uint8_t* restrict scratch,
+                         uint8_t* restrict dst) {
+        const uint16_t* up;
+        const uint16_t* vp;
+        if (cfg->input_format == CD_INPUT_P016) {
+                const uint16_t* uv_row = cfg->u16 + (size_t)jc * 2 * cw;
+                uint16_t*       u      = (uint16_t*)scratch;
+                uint16_t*       v      = u + cw;
+                for (int i = 0; i < cw; ++i) {
+                        u[i] = uv_row[2 * i];
+                        v[i] = uv_row[2 * i + 1];
+                }
+                up = u;
+                vp = v;
+        } else {
+                up = cfg->u16 + (size_t)jc * cw;
+                vp = cfg->v16 + (size_t)jc * cw;
+        }
+        if (!num_classes && !uv) {
+                box_row16(up, vp, cw, p, dst);
+                return;
+        }
+        uint8_t* qu = scratch + 4 * (size_t)cw;
+        uint8_t* qv = qu + cw;
+        for (int i = 0; i < cw; ++i) {
+                const int u = up[i] >> p->shift;
+                const int v = vp[i] >> p->shift;
+                qu[i]       = (uint8_t)(u < 255 ? u : 255);
+                qv[i]       = (uint8_t)(v < 255 ? v : 255);
+        }
+        decide_chroma_row(cfg, uv, num_classes, qu, qv, cw, dst);
+}
+
+// Per-call threshold state shared by the dense and the run pipeline.
+typedef struct {
+        const CDConfig* cfg;
+        const UVTable*  uv;
+        int             num_classes;
+        int             shift_x; // chroma subsampling, log2
+        int             shift_y;
+        int             cw;      // chroma samples per row
+        Thresh16        p16;     // 16-bit inputs only
+        uint8_t*        chroma;  // decision row of the current chroma row
+        uint8_t*        scratch; // per-format work space
+} Threshold;
+
+// Bytes of scratch threshold_init needs for a frame width.
+static size_t threshold_scratch_bytes(int width) {
+        return 8 * (size_t)width + 64;
+}
+
+// Chroma subsampling of the input planes; Bayer quads decide like 4:2:0.
+static void chroma_shifts(const CDConfig* cfg, int* shift_x, int* shift_y) {
+        *shift_x = 1;
+        *shift_y = 1;
+        if (is_bayer(cfg->input_format)) return;
+        if (cfg->chroma_format == CD_CHROMA_422) *shift_y = 0;
+        if (cfg->chroma_format == CD_CHROMA_444) *shift_x = *shift_y = 0;
+}
+
+static void threshold_init(Threshold* t, const CDConfig* cfg, const UVTable* uv, int num_classes, uint8_t* scratch) {
+        t->cfg         = cfg;
+        t->uv          = uv;
+        t->num_classes = num_classes;
+        chroma_shifts(cfg, &t->shift_x, &t->shift_y);
+        t->cw      = (cfg->width + t->shift_x) >> t->shift_x;
+        t->chroma  = scratch;
+        t->scratch = scratch + (((size_t)cfg->width + 15) & ~(size_t)15);
+        if (is_high_depth(cfg->input_format)) thresh16_params(cfg, &t->p16);
+}
+
+// Thresholds luma row j into dst. Rows must come in order: the chroma
+// decision is made on the first luma row of each chroma row and reused.
+static void threshold_row(Threshold* t, int j, uint8_t* restrict dst) {
+        const CDConfig* cfg   = t->cfg;
+        const int       jc    = j >> t->shift_y;
+        const int       fresh = j == 0 || ((j - 1) >> t->shift_y) != jc;
+        const size_t    off   = (size_t)j * cfg->width;
+        if (is_bayer(cfg->input_format)) {
+                if (fresh) bayer_chroma_row(cfg, t->uv, t->num_classes, jc, t->scratch, t->chroma);
+                expand_chroma_row(t->chroma, cfg->y + off, cfg->width, 1, 0, dst);
+        } else if (is_high_depth(cfg->input_format)) {
+                if (fresh) chroma16_row(cfg, t->uv, t->num_classes, &t->p16, jc, t->cw, t->scratch, t->chroma);
+                expand_chroma_row16(t->chroma, cfg->y16 + off, cfg->width, t->shift_x, t->p16.y_min, dst);
+        } else {
+                const size_t coff = (size_t)jc * t->cw;
+                if (fresh)
+                        decide_chroma_row(cfg, t->uv, t->num_classes, cfg->u + coff, cfg->v + coff, t->cw, t->chroma);
+                expand_chroma_row(t->chroma, cfg->y + off, cfg->width, t->shift_x, cfg->y_min, dst);
+        }
+}
+
+// The 3x3 morphology is bitwise: AND/OR is a binary erosion/dilation of every
+// bit plane at once, so one pass cleans all colour classes. On the nested
+// 0 / CD_MASK_LOOSE / CD_MASK_STRICT values it equals grey-level min/max.
+// Border pixels are peeled off so the interior loops are branch-free.
+CD_KERNEL void erode3x3_rows(const uint8_t* restrict src, int w, int h, int y0, int y1, uint8_t* restrict dst) {
+        for (int y = y0; y < y1; ++y) {
+                const uint8_t* s = src + (size_t)y * w;
+                uint8_t*       d = dst + (size_t)y * w;
+                if (y == 0 || y == h - 1 || w < 3) {
+                        memset(d, 0, (size_t)w);
+                        continue;
+                }
+                d[0] = 0;
+                for (int x = 1; x < w - 1; ++x) d[x] = s[x] & s[x - 1] & s[x + 1] & s[x - w] & s[x + w];
+                d[w - 1] = 0;
+        }
+}
+
+// Rows outside the image are replaced by the row itself, which OR ignores.
+CD_KERNEL void dilate3x3_rows(const uint8_t* restrict src, int w, int h, int y0, int y1, uint8_t* restrict dst) {
+        for (int y = y0; y < y1; ++y) {
+                const uint8_t* s  = src + (size_t)y * w;
+                const uint8_t* up = y > 0 ? s - w : s;
+                const uint8_t* dn = y + 1 < h ? s + w : s;
+                uint8_t*       d  = dst + (size_t)y * w;
+                if (w == 1) {
+                        d[0] = s[0] | up[0] | dn[0];
+                        continue;
+                }
+                d[0] = s[0] | s[1] | up[0] | dn[0];
+                for (int x = 1; x < w - 1; ++x) d[x] = s[x] | s[x - 1] | s[x + 1] | up[x] | dn[x];
+                d[w - 1] = s[w - 1] | s[w - 2] | up[w - 1] | dn[w - 1];
+        }
+}
+
+typedef void (*MorphRowsFn)(const uint8_t* restrict src, int w, int h, int y0, int y1, uint8_t* restrict dst);
+
+static void erode3x3_cross(const uint8_t* restrict src, int w, int h, int y0, int y1, uint8_t* restrict dst) {
+        erode3x3_rows(src, w, h, y0, y1, dst);
+}
+
+static void dilate3x3_cross(const uint8_t* restrict src, int w, int h, int y0, int y1, uint8_t* restrict dst) {
+        dilate3x3_rows(src, w, h, y0, y1, dst);
+}
+
+// One pass of the open+close chain over a set of row bands. Each band writes
+// rows [y0, y1) of dst and reads one halo row above and below from src, which
+// is complete because passes are separated by pool_run barriers.
+typedef struct {
+        const uint8_t* src;
+        uint8_t*       dst;
+        int            width;
+        int            height;
+        int            band_rows;
+        MorphRowsFn    rows;
+} MorphPass;
+
+static void morph_pass_band(void* arg, int band) {
+        const MorphPass* p  = (const MorphPass*)arg;
+        const int        y0 = band * p->band_rows;
+        const int        y1 = (y0 + p->band_rows < p->height) ? y0 + p->band_rows : p->height;
+        p->rows(p->src, p->width, p->height, y0, y1, p->dst);
+}
+
+// erode and dilate are erode3x3_cross / dilate3x3_cross or fixed-width copies.
+static void morph_open_close_3x3(uint8_t* restrict img,
+                                 int         width,
+                                 int         height,
+                                 uint8_t* restrict tmp1,
+                                 uint8_t* restrict tmp2,
+                                 int         num_threads,
+                                 MorphRowsFn erode,
+                                 MorphRowsFn dilate) {
         if (!img || width <= 0 || height <= 0) return;
-        erode3x3_cross(img, width, height, tmp1);
-        dilate3x3_cross(tmp1, width, height, tmp2);
-        dilate3x3_cross(tmp2, width, height, tmp1);
-        erode3x3_cross(tmp1, width, height, img);
+        // A band plus its two halo rows and its output should fit in L2 together.
+        const int threads  = pool_threads(num_threads);
+        int       band_l2  = (int)(l2_cache_bytes() / (2u * (size_t)width)) - 2;
+        int       band_min = (height + threads - 1) / threads;
+        int       rows     = band_l2 < band_min ? band_l2 : band_min;
+        if (rows < 8) rows = 8;
+        const int bands   = (height + rows - 1) / rows;
+
+        MorphPass pass[4] = {
+            {img, tmp1, width, height, rows, erode},
+            {tmp1, tmp2, width, height, rows, dilate},
+            {tmp2, tmp1, width, height, rows, dilate},
+            {tmp1, img, width, height, rows, erode},
+        };
+        for (int i = 0; i < 4; ++i) pool_run(morph_pass_band, &pass[i], bands, threads);
+}
+
+
+// Growable scratch owned by a CDContext. Contents are not preserved when a
+// buffer grows, callers treat it as uninitialised memory.
+typedef struct {
+        void*  data;
+        size_t cap;
+} CDBuffer;
+
+static void* buffer_reserve(CDBuffer* b, size_t bytes) {
+        if (b->cap >= bytes) return b->data;
+        free(b->data);
+        b->data = malloc(bytes);
+        b->cap  = b->data ? bytes : 0;
+        return b->data;
+}
+
+// Like buffer_reserve but keeps the current contents, growing geometrically.
+static void* buffer_grow(CDBuffer* b, size_t bytes) {
+        if (b->cap >= bytes) return b->data;
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < bytes) cap *= 2;
+        void* data = realloc(b->data, cap);
+        if (!data) return NULL;
+        b->data = data;
+        b->cap  = cap;
+        return data;
+}
+
+static void buffer_release(CDBuffer* b) {
+        free(b->data);
+        b->data = NULL;
+        b->cap  = 0;
 }
 
+typedef struct {
+        int x0, x1; // foreground pixels [x0, x1) of one row
+} Run;
+
+// Run-length encoded binary image: runs of row y are
+// runs[rows[y]] .. runs[rows[y + 1] - 1], sorted and separated by background.
+typedef struct {
+        CDBuffer runs;
+        CDBuffer rows;
+} RunImage;
 
 typedef struct {
         int      minx, miny, maxx, maxy;
         int      area;
         uint64_t sumx, sumy;
+        uint64_t sumxx, sumyy, sumxy; // second-order moments about the origin
+        uint64_t sumY, sumYx, sumYy;  // luma-weighted sums, only with CDConfig.luma_centroid
+        int      euler;               // runs minus links between runs of adjacent rows; holes = 1 - euler
         uint8_t  seen;
+        uint8_t  strict;              // hysteresis: holds a pixel within uv_tol_strict
+        uint8_t  cls;                 // colour class index of multi-class calls
 } BoxStats;
 
-static int        spaghetti8_label(const uint8_t* img, int width, int height, int* labels_out);
+// Optional work of the stats pass, set per call from CDConfig.
+typedef struct {
+        const uint8_t* luma;        // Y plane for luma-weighted sums, NULL when off
+        int            euler;       // hole counting: 1 for 8- and 0 for 4-connectivity (diagonal reach)
+        const uint8_t* strict_mask; // hysteresis: mask plane searched for CD_MASK_STRICT, NULL when off
+        const uint8_t* run_class;   // multi-class: class index per run of the labelled RunImage, else NULL
+} StatsExtras;
+
+static void box_stats_init(BoxStats* stats, int num_components, int width, int height) {
+        for (int i = 0; i < num_components; ++i) {
+                stats[i].minx   = width;
+                stats[i].miny   = height;
+                stats[i].maxx   = -1;
+                stats[i].maxy   = -1;
+                stats[i].area   = 0;
+                stats[i].sumx   = 0;
+                stats[i].sumy   = 0;
+                stats[i].sumxx  = 0;
+                stats[i].sumyy  = 0;
+                stats[i].sumxy  = 0;
+                stats[i].sumY   = 0;
+                stats[i].sumYx  = 0;
+                stats[i].sumYy  = 0;
+                stats[i].euler  = 0;
+                stats[i].seen   = 0;
+                stats[i].strict = 0;
+                stats[i].cls    = 0;
+        }
+}
+
+// Sum of squares 0^2 + ... + (n - 1)^2.
+static inline uint64_t sum_squares_below(uint64_t n) {
+        return n == 0 ? 0 : (n - 1) * n * (2 * n - 1) / 6;
+}
+
+// Adds the horizontal run [x0, x1) on row y: area is the run length, sumx the
+// arithmetic series x0 + ... + (x1 - 1), sumy y times the length; the second
+// moments follow the same closed forms.
+static inline void box_stats_add_run(BoxStats* s, int y, int x0, int x1) {
+        const uint64_t len = (uint64_t)(x1 - x0);
+        const uint64_t sx  = (uint64_t)(x0 + x1 - 1) * len / 2;
+        s->seen            = 1;
+        if (x0 < s->minx) s->minx = x0;
+        if (y < s->miny) s->miny = y;
+        if (x1 - 1 > s->maxx) s->maxx = x1 - 1;
+        if (y > s->maxy) s->maxy = y;
+        s->area += (int)len;
+        s->sumx += sx;
+        s->sumy += (uint64_t)y * len;
+        s->sumxx += sum_squares_below((uint64_t)x1) - sum_squares_below((uint64_t)x0);
+        s->sumyy += (uint64_t)y * (uint64_t)y * len;
+        s->sumxy += (uint64_t)y * sx;
+}
+
+// Luma-weighted sums of the same run; luma_row is the Y row of y, read only
+// over foreground runs.
+static inline void box_stats_add_luma(BoxStats* s, int y, int x0, int x1, const uint8_t* luma_row) {
+        uint64_t sy = 0, syx = 0;
+        for (int x = x0; x < x1; ++x) {
+                sy += luma_row[x];
+                syx += (uint64_t)luma_row[x] * (uint64_t)x;
+        }
+        s->sumY += sy;
+        s->sumYx += syx;
+        s->sumYy += sy * (uint64_t)y;
+}
+
+// End of the run of labels equal to row[x], scanning four (or eight) labels
+// per compare so large filled components cost about one update per row.
+static inline int label_run_end_s32(const int* row, int x, int width) {
+        const int v = row[x];
+        int       e = x + 1;
+#if defined(__SSE2__)
+        const __m128i vv = _mm_set1_epi32(v);
+        for (; e + 4 <= width; e += 4) {
+                const int m = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(row + e)), vv));
+                if (m != 0xFFFF) return e + (__builtin_ctz((unsigned)~m) >> 2);
+        }
+#endif
+        while (e < width && row[e] == v) ++e;
+        return e;
+}
+
+static inline int label_run_end_u16(const uint16_t* row, int x, int width) {
+        const uint16_t v = row[x];
+        int            e = x + 1;
+#if defined(__SSE2__)
+        const __m128i vv = _mm_set1_epi16((short)v);
+        for (; e + 8 <= width; e += 8) {
+                const int m = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(row + e)), vv));
+                if (m != 0xFFFF) return e + (__builtin_ctz((unsigned)~m) >> 1);
+        }
+#endif
+        while (e < width && row[e] == v) ++e;
+        return e;
+}
+
+// Number of foreground runs of the previous label row meeting [a, b).
+static inline int prev_runs_s32(const int* prev, int a, int b, int width) {
+        if (a < 0) a = 0;
+        if (b > width) b = width;
+        int n = 0;
+        for (int p = a; p < b;) {
+                if (prev[p]) {
+                        ++n;
+                        p = label_run_end_s32(prev, p, width);
+                } else {
+                        ++p;
+                }
+        }
+        return n;
+}
+
+static inline int prev_runs_u16(const uint16_t* prev, int a, int b, int width) {
+        if (a < 0) a = 0;
+        if (b > width) b = width;
+        int n = 0;
+        for (int p = a; p < b;) {
+                if (prev[p]) {
+                        ++n;
+                        p = label_run_end_u16(prev, p, width);
+                } else {
+                        ++p;
+                }
+        }
+        return n;
+}
+
+// Folds one finished label row into the stats. prev is the label row above
+// (NULL on the first row); it is only read for hole counting. A run of equal
+// labels is a foreground run, and every foreground run of prev that it meets
+// belongs to the same component, so each such pair is one link.
+static void
+box_stats_row_s32(const int* row, const int* prev, int width, int y, const StatsExtras* ex, BoxStats* stats) {
+        const uint8_t* luma_row = ex->luma ? ex->luma + (size_t)y * width : NULL;
+        for (int x = 0; x < width;) {
+                const int e = label_run_end_s32(row, x, width);
+                if (row[x] > 0) {
+                        BoxStats* s = &stats[row[x]];
+                        box_stats_add_run(s, y, x, e);
+                        if (luma_row) box_stats_add_luma(s, y, x, e, luma_row);
+                        s->euler += 1;
+                        if (prev) s->euler -= prev_runs_s32(prev, x - ex->euler, e + ex->euler, width);
+                        if (ex->strict_mask && !s->strict) {
+                                const uint8_t* m = ex->strict_mask + (size_t)y * width;
+                                s->strict        = memchr(m + x, CD_MASK_STRICT, e - x) != NULL;
+                        }
+                }
+                x = e;
+        }
+}
+
+static void box_stats_row_u16(
+    const uint16_t* row, const uint16_t* prev, int width, int y, const StatsExtras* ex, BoxStats* stats) {
+        const uint8_t* luma_row = ex->luma ? ex->luma + (size_t)y * width : NULL;
+        for (int x = 0; x < width;) {
+                const int e = label_run_end_u16(row, x, width);
+                if (row[x] > 0) {
+                        BoxStats* s = &stats[row[x]];
+                        box_stats_add_run(s, y, x, e);
+                        if (luma_row) box_stats_add_luma(s, y, x, e, luma_row);
+                        s->euler += 1;
+                        if (prev) s->euler -= prev_runs_u16(prev, x - ex->euler, e + ex->euler, width);
+                        if (ex->strict_mask && !s->strict) {
+                                const uint8_t* m = ex->strict_mask + (size_t)y * width;
+                                s->strict        = memchr(m + x, CD_MASK_STRICT, e - x) != NULL;
+                        }
+                }
+                x = e;
+        }
+}
+
+struct CDContext {
+        CDBuffer       parents;      // union-find parents, one per provisional label
+        CDBuffer       block_labels; // provisional label per 2x2 block
+        CDBuffer       stats;        // BoxStats per final label
+        RunImage       run_mask;     // run-length pipeline: thresholded/morphed mask
+        RunImage       run_tmp;      // run-length pipeline: morphology ping-pong
+        RunImage       run_strict;   // run-length pipeline: hysteresis seed pixels
+        CDBuffer       run_labels;   // provisional label per run
+        CDBuffer       run_class;    // multi-class calls: class index per run of run_mask
+        CDBuffer       row_scratch;  // one mask row plus per-row run lists
+        CDBuffer       provisional;  // pixel-based labelers: two-row provisional window for 16-bit output
+        CDBuffer       candidates;   // CDCircleEx per accepted component, in output order
+        CDBuffer       fit_pixels;   // boundary refinement: traced contour of one candidate
+        CDBuffer       fit_points;   // refinement: x/y pairs fed to the circle fit
+        CDBuffer       merge_links;  // fragment merging: parent, grid link and fragment count per label
+        CDBuffer       merge_grid;   // fragment merging: first label per grid cell
+        CDBuffer       split_map;    // touching-circle split: distance, region and queue link per bbox pixel
+        CDBuffer       split_heads;  // touching-circle split: bucket queue heads per distance
+        CDBuffer       uv_table;     // UVTable for the current non-box UV region
+        CDBuffer       uv_polygon;   // copy of the polygon uv_table was built from
+        StatsExtras    extras;       // optional stats-pass work for the current call
+};
+
+static int
+spaghetti8_label(CDContext* ctx, const uint8_t* img, int width, int height, void* labels_out, int label_format);
 static inline int findRoot(const int* P, int i) {
         int root = i;
         while (P[root] < root) {
@@ -168,6 +1111,7 @@ static inline int set_union(int* P, int i, int j) {
                 }
                 setRoot(P, j, root);
         }
+        setRoot(P, i, root);
         return root;
 }
 static inline void flattenLParallel(int* P, int start, int nElem, int* k) {
@@ -184,40 +1128,148 @@ static inline int stripeFirstLabel8Connectivity(int y, int w) {
         ((void)0);
         return (y / 2) * ((w + 1) / 2) + 1;
 }
-static int spaghetti8_label(const uint8_t* img, int width, int height, int* labels_out) {
-        const int ow    = width;
-        const int oh    = height;
-        const int w_pad = ow + 4;
-        const int h_pad = oh;
-        (void)(h_pad);
-        const int    max_labels    = ((oh + 1) / 2) * ((ow + 1) / 2) + 4;
-        const size_t pad_pixels    = (size_t)w_pad * h_pad;
-        const size_t labels_needed = (size_t)ow * oh;
-
-        int*         P_            = (int*)malloc(((size_t)max_labels + 2) * sizeof(int));
-        uint8_t*     img_pad       = (uint8_t*)malloc(pad_pixels);
-        int*         labels_pad    = (int*)malloc(pad_pixels * sizeof(int));
-
-        if (!P_ || !img_pad || !labels_pad) {
-                if (P_) free(P_);
-                if (img_pad) free(img_pad);
-                if (labels_pad) free(labels_pad);
-                return 0;
-        }
-
-        memset(P_, 0, ((size_t)max_labels + 2) * sizeof(int));
-        memset(img_pad, 0, pad_pixels);
-        memset(labels_pad, 0, pad_pixels * sizeof(int));
-        for (int y = 0; y < oh; ++y) {
-                memcpy(img_pad + y * w_pad + 2, img + y * ow, (size_t)ow);
-        }
-        memset(labels_out, 0, labels_needed * sizeof(int));
+// First column at or after x where any of the three rows is non-zero,
+// advancing over whole 32-column spans only and never past limit.
+static inline int skip_zero_columns3(const uint8_t* a, const uint8_t* b, const uint8_t* c, int x, int limit) {
+        for (; x + 32 <= limit; x += 32) {
+#if defined(__SSE2__)
+                const __m128i lo = _mm_or_si128(_mm_or_si128(_mm_loadu_si128((const __m128i*)(a + x)),
+                                                             _mm_loadu_si128((const __m128i*)(b + x))),
+                                                _mm_loadu_si128((const __m128i*)(c + x)));
+                const __m128i hi = _mm_or_si128(_mm_or_si128(_mm_loadu_si128((const __m128i*)(a + x + 16)),
+                                                             _mm_loadu_si128((const __m128i*)(b + x + 16))),
+                                                _mm_loadu_si128((const __m128i*)(c + x + 16)));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF) break;
+#else
+                uint64_t any = 0;
+                for (int k = 0; k < 32; k += 8) {
+                        uint64_t wa, wb, wc;
+                        memcpy(&wa, a + x + k, 8);
+                        memcpy(&wb, b + x + k, 8);
+                        memcpy(&wc, c + x + k, 8);
+                        any |= wa | wb | wc;
+                }
+                if (any) break;
+#endif
+        }
+        return x;
+}
+
+// Writes the final label of every pixel from the provisional label of its
+// 2x2 block, background pixels get 0. Each row pair is folded into the
+// per-label stats right after it is written, while it is still in cache.
+static void expand_block_labels_s32(const uint8_t*     img,
+                                    int                w,
+                                    int                h,
+                                    const int*         block_labels,
+                                    const int*         P,
+                                    int* restrict      labels_out,
+                                    const StatsExtras* ex,
+                                    BoxStats*          stats) {
+        const int bw = (w + 1) / 2;
+        for (int r = 0; r < h; r += 2) {
+                const int* const     blk     = block_labels + (size_t)(r >> 1) * bw;
+                const uint8_t* const src     = img + (size_t)r * w;
+                int* const           dst     = labels_out + (size_t)r * w;
+                const int            has_fol = r + 1 < h;
+                const uint8_t* const fol     = has_fol ? src + w : src;
+                for (int c = 0; c < w; c += 2) {
+                        // Blocks skipped by the scanner have no label written, so
+                        // only look one up when the block has a foreground pixel,
+                        // and clear whole background spans at once.
+                        const int any = src[c] | (c + 1 < w ? src[c + 1] : 0) |
+                                        (has_fol ? fol[c] | (c + 1 < w ? fol[c + 1] : 0) : 0);
+                        if (!any) {
+                                const int skip = skip_zero_columns3(src, fol, fol, c, w);
+                                if (skip > c) {
+                                        memset(dst + c, 0, (size_t)(skip - c) * sizeof(int));
+                                        if (has_fol) memset(dst + w + c, 0, (size_t)(skip - c) * sizeof(int));
+                                        c = skip - 2;
+                                        continue;
+                                }
+                        }
+                        int root = any ? P[blk[c >> 1]] : 0;
+                        dst[c]   = src[c] ? root : 0;
+                        if (c + 1 < w) dst[c + 1] = src[c + 1] ? root : 0;
+                        if (has_fol) {
+                                dst[w + c] = src[w + c] ? root : 0;
+                                if (c + 1 < w) dst[w + c + 1] = src[w + c + 1] ? root : 0;
+                        }
+                }
+                box_stats_row_s32(dst, r > 0 ? dst - w : NULL, w, r, ex, stats);
+                if (has_fol) box_stats_row_s32(dst + w, dst, w, r + 1, ex, stats);
+        }
+}
+
+// Same as expand_block_labels_s32 for 16-bit output; the caller guarantees
+// every final label fits.
+static void expand_block_labels_u16(const uint8_t*     img,
+                                    int                w,
+                                    int                h,
+                                    const int*         block_labels,
+                                    const int*         P,
+                                    uint16_t* restrict labels_out,
+                                    const StatsExtras* ex,
+                                    BoxStats*          stats) {
+        const int bw = (w + 1) / 2;
+        for (int r = 0; r < h; r += 2) {
+                const int* const     blk     = block_labels + (size_t)(r >> 1) * bw;
+                const uint8_t* const src     = img + (size_t)r * w;
+                uint16_t* const      dst     = labels_out + (size_t)r * w;
+                const int            has_fol = r + 1 < h;
+                const uint8_t* const fol     = has_fol ? src + w : src;
+                for (int c = 0; c < w; c += 2) {
+                        const int any = src[c] | (c + 1 < w ? src[c + 1] : 0) |
+                                        (has_fol ? fol[c] | (c + 1 < w ? fol[c + 1] : 0) : 0);
+                        if (!any) {
+                                const int skip = skip_zero_columns3(src, fol, fol, c, w);
+                                if (skip > c) {
+                                        memset(dst + c, 0, (size_t)(skip - c) * sizeof(uint16_t));
+                                        if (has_fol) memset(dst + w + c, 0, (size_t)(skip - c) * sizeof(uint16_t));
+                                        c = skip - 2;
+                                        continue;
+                                }
+                        }
+                        uint16_t root = (uint16_t)(any ? P[blk[c >> 1]] : 0);
+                        dst[c]        = src[c] ? root : 0;
+                        if (c + 1 < w) dst[c + 1] = src[c + 1] ? root : 0;
+                        if (has_fol) {
+                                dst[w + c] = src[w + c] ? root : 0;
+                                if (c + 1 < w) dst[w + c + 1] = src[w + c + 1] ? root : 0;
+                        }
+                }
+                box_stats_row_u16(dst, r > 0 ? dst - w : NULL, w, r, ex, stats);
+                if (has_fol) box_stats_row_u16(dst + w, dst, w, r + 1, ex, stats);
+        }
+}
+
+// Spaghetti 8-connectivity labeling straight off the caller's mask. Blocks in
+// the first column are entered through the *_tree_0 start states, which never
+// look left of c, and the last one or two columns go through the *_break_*
+// tails, which never look right of the row. Provisional labels are kept per
+// 2x2 block in a compact ((w+1)/2) x ((h+1)/2) array.
+static int
+spaghetti8_label(CDContext* ctx, const uint8_t* img, int width, int height, void* labels_out, int label_format) {
+        const int    ow         = width;
+        const int    oh         = height;
+        const int    bw         = (ow + 1) / 2;
+        const int    bh         = (oh + 1) / 2;
+        const int    max_labels = bh * bw + 4;
+
+        int*         P_           = (int*)buffer_reserve(&ctx->parents, ((size_t)max_labels + 2) * sizeof(int));
+        int*         block_labels = (int*)buffer_reserve(&ctx->block_labels, (size_t)bw * bh * sizeof(int));
+        if (!P_ || !block_labels) return 0;
+
+        // Nothing needs clearing: every P_ entry in use is written when its
+        // label is created, and block_labels/labels_out cells are written
+        // before anything reads them.
+        P_[0] = 0;
         int       label      = stripeFirstLabel8Connectivity(0, ow);
         const int firstLabel = label;
-        const int w          = w_pad;
+        const int w          = ow;
         if (oh == 1) {
-                const uint8_t* const img_row        = img_pad + 2;
-                int* const           img_labels_row = labels_pad + 2;
+                const uint8_t* const img_row        = img;
+                int* const           img_labels_row = block_labels;
                 int                  c              = -2;
         sl_tree_0:
                 if ((c += 2) >= w - 2) {
@@ -229,13 +1281,13 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                 }
                 if (img_row[c] > 0) {
                         if (img_row[c + 1] > 0) {
-                                img_labels_row[c] = label;
+                                img_labels_row[c >> 1] = label;
                                 P_[label]         = label;
                                 ((void)0);
                                 label = label + 1;
                                 goto sl_tree_1;
                         } else {
-                                img_labels_row[c] = label;
+                                img_labels_row[c >> 1] = label;
                                 P_[label]         = label;
                                 ((void)0);
                                 label = label + 1;
@@ -244,13 +1296,13 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                 } else {
                 NODE_372:
                         if (img_row[c + 1] > 0) {
-                                img_labels_row[c] = label;
+                                img_labels_row[c >> 1] = label;
                                 P_[label]         = label;
                                 ((void)0);
                                 label = label + 1;
                                 goto sl_tree_1;
                         } else {
-                                img_labels_row[c] = 0;
+                                img_labels_row[c >> 1] = 0;
                                 goto sl_tree_0;
                         }
                 }
@@ -264,10 +1316,10 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                 }
                 if (img_row[c] > 0) {
                         if (img_row[c + 1] > 0) {
-                                img_labels_row[c] = img_labels_row[c - 2];
+                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 goto sl_tree_1;
                         } else {
-                                img_labels_row[c] = img_labels_row[c - 2];
+                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 goto sl_tree_0;
                         }
                 } else {
@@ -275,30 +1327,30 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                 }
         sl_break_0_0:
                 if (img_row[c] > 0) {
-                        img_labels_row[c] = label;
+                        img_labels_row[c >> 1] = label;
                         P_[label]         = label;
                         ((void)0);
                         label = label + 1;
                 } else {
-                        img_labels_row[c] = 0;
+                        img_labels_row[c >> 1] = 0;
                 }
                 goto end_sl;
         sl_break_0_1:
                 if (img_row[c] > 0) {
-                        img_labels_row[c] = img_labels_row[c - 2];
+                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                 } else {
-                        img_labels_row[c] = 0;
+                        img_labels_row[c >> 1] = 0;
                 }
                 goto end_sl;
         sl_break_1_0:
                 if (img_row[c] > 0) {
                         if (img_row[c + 1] > 0) {
-                                img_labels_row[c] = label;
+                                img_labels_row[c >> 1] = label;
                                 P_[label]         = label;
                                 ((void)0);
                                 label = label + 1;
                         } else {
-                                img_labels_row[c] = label;
+                                img_labels_row[c >> 1] = label;
                                 P_[label]         = label;
                                 ((void)0);
                                 label = label + 1;
@@ -306,21 +1358,21 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                 } else {
                 NODE_375:
                         if (img_row[c + 1] > 0) {
-                                img_labels_row[c] = label;
+                                img_labels_row[c >> 1] = label;
                                 P_[label]         = label;
                                 ((void)0);
                                 label = label + 1;
                         } else {
-                                img_labels_row[c] = 0;
+                                img_labels_row[c >> 1] = 0;
                         }
                 }
                 goto end_sl;
         sl_break_1_1:
                 if (img_row[c] > 0) {
                         if (img_row[c + 1] > 0) {
-                                img_labels_row[c] = img_labels_row[c - 2];
+                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                         } else {
-                                img_labels_row[c] = img_labels_row[c - 2];
+                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                         }
                 } else {
                         goto NODE_375;
@@ -329,9 +1381,9 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
         end_sl:;
         } else {
                 {
-                        const uint8_t* const img_row        = img_pad + 2;
-                        const uint8_t* const img_row_fol    = img_row + w_pad;
-                        int* const           img_labels_row = labels_pad + 2;
+                        const uint8_t* const img_row        = img;
+                        const uint8_t* const img_row_fol    = img_row + ow;
+                        int* const           img_labels_row = block_labels;
                         int                  c              = -2;
                 fl_tree_0:
                         if ((c += 2) >= w - 2) {
@@ -344,13 +1396,13 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                         NODE_253:
                                 if (img_row[c + 1] > 0) {
-                                        img_labels_row[c] = label;
+                                        img_labels_row[c >> 1] = label;
                                         P_[label]         = label;
                                         ((void)0);
                                         label = label + 1;
                                         goto fl_tree_1;
                                 } else {
-                                        img_labels_row[c] = label;
+                                        img_labels_row[c >> 1] = label;
                                         P_[label]         = label;
                                         ((void)0);
                                         label = label + 1;
@@ -362,20 +1414,20 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 } else {
                                 NODE_255:
                                         if (img_row[c + 1] > 0) {
-                                                img_labels_row[c] = label;
+                                                img_labels_row[c >> 1] = label;
                                                 P_[label]         = label;
                                                 ((void)0);
                                                 label = label + 1;
                                                 goto fl_tree_1;
                                         } else {
                                                 if (img_row_fol[c + 1] > 0) {
-                                                        img_labels_row[c] = label;
+                                                        img_labels_row[c >> 1] = label;
                                                         P_[label]         = label;
                                                         ((void)0);
                                                         label = label + 1;
                                                         goto fl_tree_1;
                                                 } else {
-                                                        img_labels_row[c] = 0;
+                                                        img_labels_row[c >> 1] = 0;
                                                         goto fl_tree_0;
                                                 }
                                         }
@@ -392,10 +1444,10 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                         NODE_257:
                                 if (img_row[c + 1] > 0) {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         goto fl_tree_1;
                                 } else {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         goto fl_tree_2;
                                 }
                         } else {
@@ -423,10 +1475,10 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 if (img_row_fol[c] > 0) {
                                         if (img_row[c + 1] > 0) {
                                                 if (img_row_fol[c - 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto fl_tree_1;
                                                 } else {
-                                                        img_labels_row[c] = label;
+                                                        img_labels_row[c >> 1] = label;
                                                         P_[label]         = label;
                                                         ((void)0);
                                                         label = label + 1;
@@ -434,10 +1486,10 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 }
                                         } else {
                                                 if (img_row_fol[c - 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto fl_tree_2;
                                                 } else {
-                                                        img_labels_row[c] = label;
+                                                        img_labels_row[c >> 1] = label;
                                                         P_[label]         = label;
                                                         ((void)0);
                                                         label = label + 1;
@@ -450,29 +1502,29 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         }
                 fl_break_0_0:
                         if (img_row[c] > 0) {
-                                img_labels_row[c] = label;
+                                img_labels_row[c >> 1] = label;
                                 P_[label]         = label;
                                 ((void)0);
                                 label = label + 1;
                         } else {
                                 if (img_row_fol[c] > 0) {
-                                        img_labels_row[c] = label;
+                                        img_labels_row[c >> 1] = label;
                                         P_[label]         = label;
                                         ((void)0);
                                         label = label + 1;
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                 }
                         }
                         goto end_fl;
                 fl_break_0_1:
                         if (img_row[c] > 0) {
-                                img_labels_row[c] = img_labels_row[c - 2];
+                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                         } else {
                                 if (img_row_fol[c] > 0) {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                 }
                         }
                         goto end_fl;
@@ -480,9 +1532,9 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                         NODE_266:
                                 if (img_row_fol[c - 1] > 0) {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 } else {
-                                        img_labels_row[c] = label;
+                                        img_labels_row[c >> 1] = label;
                                         P_[label]         = label;
                                         ((void)0);
                                         label = label + 1;
@@ -491,7 +1543,7 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 if (img_row_fol[c] > 0) {
                                         goto NODE_266;
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                 }
                         }
                         goto end_fl;
@@ -499,12 +1551,12 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                         NODE_268:
                                 if (img_row[c + 1] > 0) {
-                                        img_labels_row[c] = label;
+                                        img_labels_row[c >> 1] = label;
                                         P_[label]         = label;
                                         ((void)0);
                                         label = label + 1;
                                 } else {
-                                        img_labels_row[c] = label;
+                                        img_labels_row[c >> 1] = label;
                                         P_[label]         = label;
                                         ((void)0);
                                         label = label + 1;
@@ -515,18 +1567,18 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 } else {
                                 NODE_270:
                                         if (img_row[c + 1] > 0) {
-                                                img_labels_row[c] = label;
+                                                img_labels_row[c >> 1] = label;
                                                 P_[label]         = label;
                                                 ((void)0);
                                                 label = label + 1;
                                         } else {
                                                 if (img_row_fol[c + 1] > 0) {
-                                                        img_labels_row[c] = label;
+                                                        img_labels_row[c >> 1] = label;
                                                         P_[label]         = label;
                                                         ((void)0);
                                                         label = label + 1;
                                                 } else {
-                                                        img_labels_row[c] = 0;
+                                                        img_labels_row[c >> 1] = 0;
                                                 }
                                         }
                                 }
@@ -536,9 +1588,9 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                         NODE_272:
                                 if (img_row[c + 1] > 0) {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 } else {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 }
                         } else {
                                 if (img_row_fol[c] > 0) {
@@ -571,12 +1623,12 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                 }
                 const int e_rows = oh & -2;
                 for (int r = 2; r < e_rows; r += 2) {
-                        const uint8_t* const img_row                  = img_pad + r * w_pad + 2;
-                        const uint8_t* const img_row_prev             = img_row - w_pad;
-                        const uint8_t* const img_row_prev_prev        = img_row_prev - w_pad;
-                        const uint8_t* const img_row_fol              = img_row + w_pad;
-                        int* const           img_labels_row           = labels_pad + r * w_pad + 2;
-                        int* const           img_labels_row_prev_prev = img_labels_row - 2 * w_pad;
+                        const uint8_t* const img_row                  = img + (size_t)r * ow;
+                        const uint8_t* const img_row_prev             = img_row - ow;
+                        const uint8_t* const img_row_prev_prev        = img_row_prev - ow;
+                        const uint8_t* const img_row_fol              = img_row + ow;
+                        int* const           img_labels_row           = block_labels + (size_t)(r >> 1) * bw;
+                        int* const           img_labels_row_prev_prev = img_labels_row - bw;
                         int                  c                        = -2;
                         goto tree_0;
                 tree_0:
@@ -587,10 +1639,23 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         goto break_1_0;
                                 }
                         }
+                        {
+                                // Columns [c, skip) are background on rows r-1..r+1:
+                                // none of those blocks gets a label or a union, and
+                                // no later read of their block labels can happen.
+                                // The block after the span has a background left
+                                // context, which is what tree_0 assumes.
+                                const int skip = skip_zero_columns3(img_row_prev, img_row, img_row_fol, c, w);
+                                if (skip >= w) continue;
+                                if (skip > c) {
+                                        c = skip - 2;
+                                        goto tree_0;
+                                }
+                        }
                         if (img_row[c] > 0) {
                         NODE_1:
                                 if (img_row_prev[c + 1] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                         goto tree_11;
                                 } else {
                                         if (img_row[c + 1] > 0) {
@@ -599,26 +1664,26 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                         if (img_row_prev[c] > 0) {
                                                         NODE_5:
                                                                 if (img_row_prev_prev[c + 1] > 0) {
-                                                                        img_labels_row[c] =
-                                                                            img_labels_row_prev_prev[c + 2];
+                                                                        img_labels_row[c >> 1] =
+                                                                            img_labels_row_prev_prev[(c >> 1) + 1];
                                                                         goto tree_5;
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c],
-                                                                                      img_labels_row_prev_prev[c + 2]);
+                                                                                      img_labels_row_prev_prev[c >> 1],
+                                                                                      img_labels_row_prev_prev[(c >> 1) + 1]);
                                                                         goto tree_5;
                                                                 }
                                                         } else {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c + 2];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) + 1];
                                                                 goto tree_5;
                                                         }
                                                 } else {
                                                         if (img_row_prev[c] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                 goto tree_4;
                                                         } else {
-                                                                img_labels_row[c] = label;
+                                                                img_labels_row[c >> 1] = label;
                                                                 P_[label]         = label;
                                                                 ((void)0);
                                                                 label = label + 1;
@@ -627,10 +1692,10 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 }
                                         } else {
                                                 if (img_row_prev[c] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto tree_10;
                                                 } else {
-                                                        img_labels_row[c] = label;
+                                                        img_labels_row[c >> 1] = label;
                                                         P_[label]         = label;
                                                         ((void)0);
                                                         label = label + 1;
@@ -644,13 +1709,13 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         if (img_row[c + 1] > 0) {
                                         NODE_10:
                                                 if (img_row_prev[c + 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto tree_6;
                                                 } else {
                                                         goto NODE_3;
                                                 }
                                         } else {
-                                                img_labels_row[c] = label;
+                                                img_labels_row[c >> 1] = label;
                                                 P_[label]         = label;
                                                 ((void)0);
                                                 label = label + 1;
@@ -663,13 +1728,13 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         } else {
                                         NODE_12:
                                                 if (img_row_fol[c + 1] > 0) {
-                                                        img_labels_row[c] = label;
+                                                        img_labels_row[c >> 1] = label;
                                                         P_[label]         = label;
                                                         ((void)0);
                                                         label = label + 1;
                                                         goto tree_2;
                                                 } else {
-                                                        img_labels_row[c] = 0;
+                                                        img_labels_row[c >> 1] = 0;
                                                         goto tree_1;
                                                 }
                                         }
@@ -683,27 +1748,35 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         goto break_1_1;
                                 }
                         }
+                        {
+                                const int skip = skip_zero_columns3(img_row_prev, img_row, img_row_fol, c, w);
+                                if (skip >= w) continue;
+                                if (skip > c) {
+                                        c = skip - 2;
+                                        goto tree_0;
+                                }
+                        }
                         if (img_row[c] > 0) {
                         NODE_13:
                                 if (img_row_prev[c + 1] > 0) {
                                         if (img_row_prev[c] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 goto tree_11;
                                         } else {
                                                 if (img_row_prev[c - 1] > 0) {
                                                 NODE_16:
                                                         if (img_row_prev_prev[c] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                 goto tree_11;
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c - 2],
-                                                                              img_labels_row_prev_prev[c]);
+                                                                              img_labels_row_prev_prev[(c >> 1) - 1],
+                                                                              img_labels_row_prev_prev[c >> 1]);
                                                                 goto tree_11;
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto tree_11;
                                                 }
                                         }
@@ -717,43 +1790,43 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                 NODE_21:
                                                                         if (img_row_prev_prev[c + 1] > 0) {
                                                                                 if (img_row_prev_prev[c] > 0) {
-                                                                                        img_labels_row[c] =
-                                                                                            img_labels_row_prev_prev[c +
-                                                                                                                     2];
+                                                                                        img_labels_row[c >> 1] =
+                                                                                            img_labels_row_prev_prev[(c >> 1) +
+                                                                                                                     1];
                                                                                         goto tree_5;
                                                                                 } else {
-                                                                                        img_labels_row[c] = set_union(
+                                                                                        img_labels_row[c >> 1] = set_union(
                                                                                             P_,
-                                                                                            img_labels_row_prev_prev[c -
-                                                                                                                     2],
+                                                                                            img_labels_row_prev_prev[(c >> 1) -
+                                                                                                                     1],
                                                                                             img_labels_row_prev_prev
-                                                                                                [c + 2]);
+                                                                                                [(c >> 1) + 1]);
                                                                                         goto tree_5;
                                                                                 }
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c - 2],
-                                                                                    img_labels_row_prev_prev[c + 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) - 1],
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1]);
                                                                                 goto tree_5;
                                                                         }
                                                                 } else {
-                                                                        img_labels_row[c] =
-                                                                            img_labels_row_prev_prev[c + 2];
+                                                                        img_labels_row[c >> 1] =
+                                                                            img_labels_row_prev_prev[(c >> 1) + 1];
                                                                         goto tree_5;
                                                                 }
                                                         }
                                                 } else {
                                                         if (img_row_prev[c] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                 goto tree_4;
                                                         } else {
                                                                 if (img_row_prev[c - 1] > 0) {
-                                                                        img_labels_row[c] =
-                                                                            img_labels_row_prev_prev[c - 2];
+                                                                        img_labels_row[c >> 1] =
+                                                                            img_labels_row_prev_prev[(c >> 1) - 1];
                                                                         goto tree_3;
                                                                 } else {
-                                                                        img_labels_row[c] = label;
+                                                                        img_labels_row[c >> 1] = label;
                                                                         P_[label]         = label;
                                                                         ((void)0);
                                                                         label = label + 1;
@@ -763,14 +1836,14 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 }
                                         } else {
                                                 if (img_row_prev[c] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto tree_10;
                                                 } else {
                                                         if (img_row_prev[c - 1] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c - 2];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) - 1];
                                                                 goto tree_9;
                                                         } else {
-                                                                img_labels_row[c] = label;
+                                                                img_labels_row[c >> 1] = label;
                                                                 P_[label]         = label;
                                                                 ((void)0);
                                                                 label = label + 1;
@@ -794,29 +1867,29 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         NODE_27:
                                 if (img_row_prev[c + 1] > 0) {
                                         if (img_row_prev[c] > 0) {
-                                                img_labels_row[c] =
-                                                    set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                img_labels_row[c >> 1] =
+                                                    set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 goto tree_11;
                                         } else {
                                                 if (img_row_prev[c - 1] > 0) {
                                                         if (img_row_prev_prev[c] > 0) {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[c >> 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto tree_11;
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
                                                                               set_union(P_,
-                                                                                        img_labels_row_prev_prev[c - 2],
-                                                                                        img_labels_row_prev_prev[c]),
-                                                                              img_labels_row[c - 2]);
+                                                                                        img_labels_row_prev_prev[(c >> 1) - 1],
+                                                                                        img_labels_row_prev_prev[c >> 1]),
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto tree_11;
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                         goto tree_11;
                                                 }
                                         }
@@ -825,97 +1898,97 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 if (img_row_prev[c + 2] > 0) {
                                                         if (img_row_prev[c] > 0) {
                                                                 if (img_row_prev_prev[c + 1] > 0) {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c + 2],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_5;
                                                                 } else {
-                                                                        img_labels_row[c] = set_union(
+                                                                        img_labels_row[c >> 1] = set_union(
                                                                             P_,
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c],
-                                                                                      img_labels_row_prev_prev[c + 2]),
-                                                                            img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[c >> 1],
+                                                                                      img_labels_row_prev_prev[(c >> 1) + 1]),
+                                                                            img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_5;
                                                                 }
                                                         } else {
                                                                 if (img_row_prev[c - 1] > 0) {
                                                                         if (img_row_prev_prev[c + 1] > 0) {
                                                                                 if (img_row_prev_prev[c] > 0) {
-                                                                                        img_labels_row[c] = set_union(
+                                                                                        img_labels_row[c >> 1] = set_union(
                                                                                             P_,
-                                                                                            img_labels_row_prev_prev[c +
-                                                                                                                     2],
-                                                                                            img_labels_row[c - 2]);
+                                                                                            img_labels_row_prev_prev[(c >> 1) +
+                                                                                                                     1],
+                                                                                            img_labels_row[(c >> 1) - 1]);
                                                                                         goto tree_5;
                                                                                 } else {
-                                                                                        img_labels_row[c] = set_union(
+                                                                                        img_labels_row[c >> 1] = set_union(
                                                                                             P_,
                                                                                             set_union(
                                                                                                 P_,
                                                                                                 img_labels_row_prev_prev
-                                                                                                    [c - 2],
+                                                                                                    [(c >> 1) - 1],
                                                                                                 img_labels_row_prev_prev
-                                                                                                    [c + 2]),
-                                                                                            img_labels_row[c - 2]);
+                                                                                                    [(c >> 1) + 1]),
+                                                                                            img_labels_row[(c >> 1) - 1]);
                                                                                         goto tree_5;
                                                                                 }
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
                                                                                     set_union(
                                                                                         P_,
-                                                                                        img_labels_row_prev_prev[c - 2],
-                                                                                        img_labels_row_prev_prev[c +
-                                                                                                                 2]),
-                                                                                    img_labels_row[c - 2]);
+                                                                                        img_labels_row_prev_prev[(c >> 1) - 1],
+                                                                                        img_labels_row_prev_prev[(c >> 1) +
+                                                                                                                 1]),
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto tree_5;
                                                                         }
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c + 2],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_5;
                                                                 }
                                                         }
                                                 } else {
                                                         if (img_row_prev[c - 1] > 0) {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c - 2],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[(c >> 1) - 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto tree_8;
                                                         } else {
                                                         NODE_39:
                                                                 if (img_row_prev[c] > 0) {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[c >> 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_4;
                                                                 } else {
-                                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                                         goto tree_3;
                                                                 }
                                                         }
                                                 }
                                         } else {
                                                 if (img_row_prev[c - 1] > 0) {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c - 2], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[(c >> 1) - 1], img_labels_row[(c >> 1) - 1]);
                                                         goto tree_12;
                                                 } else {
                                                 NODE_41:
                                                         if (img_row_prev[c] > 0) {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[c >> 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto tree_10;
                                                         } else {
-                                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                                 goto tree_9;
                                                         }
                                                 }
@@ -926,34 +1999,34 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         if (img_row[c + 1] > 0) {
                                         NODE_44:
                                                 if (img_row_prev[c + 1] > 0) {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                         goto tree_6;
                                                 } else {
                                                 NODE_45:
                                                         if (img_row_prev[c + 2] > 0) {
                                                                 if (img_row_prev_prev[c + 1] > 0) {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c + 2],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_5;
                                                                 } else {
                                                                         if (img_row_prev[c] > 0) {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
                                                                                     set_union(
                                                                                         P_,
-                                                                                        img_labels_row_prev_prev[c],
-                                                                                        img_labels_row_prev_prev[c +
-                                                                                                                 2]),
-                                                                                    img_labels_row[c - 2]);
+                                                                                        img_labels_row_prev_prev[c >> 1],
+                                                                                        img_labels_row_prev_prev[(c >> 1) +
+                                                                                                                 1]),
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto tree_5;
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c + 2],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto tree_5;
                                                                         }
                                                                 }
@@ -962,7 +2035,7 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                         }
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto tree_7;
                                         }
                                 } else {
@@ -979,22 +2052,22 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         }
                         if (img_row[c] > 0) {
                                 if (img_row_prev[c + 1] > 0) {
-                                        img_labels_row[c] =
-                                            set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                        img_labels_row[c >> 1] =
+                                            set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                         goto tree_11;
                                 } else {
                                         if (img_row[c + 1] > 0) {
                                         NODE_50:
                                                 if (img_row_prev[c + 2] > 0) {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c + 2], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[(c >> 1) + 1], img_labels_row[(c >> 1) - 1]);
                                                         goto tree_5;
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto tree_8;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto tree_12;
                                         }
                                 }
@@ -1002,28 +2075,28 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 if (img_row_fol[c] > 0) {
                                         if (img_row[c + 1] > 0) {
                                                 if (img_row_prev[c + 1] > 0) {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                         goto tree_6;
                                                 } else {
                                                         goto NODE_50;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto tree_7;
                                         }
                                 } else {
                                 NODE_54:
                                         if (img_row[c + 1] > 0) {
                                                 if (img_row_prev[c + 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto tree_6;
                                                 } else {
                                                         if (img_row_prev[c + 2] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c + 2];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) + 1];
                                                                 goto tree_5;
                                                         } else {
-                                                                img_labels_row[c] = label;
+                                                                img_labels_row[c >> 1] = label;
                                                                 P_[label]         = label;
                                                                 ((void)0);
                                                                 label = label + 1;
@@ -1048,16 +2121,16 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         if (img_row_prev_prev[c] > 0) {
                                         NODE_59:
                                                 if (img_row_prev_prev[c - 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto tree_11;
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                         goto tree_11;
                                                 }
                                         } else {
-                                                img_labels_row[c] =
-                                                    set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                img_labels_row[c >> 1] =
+                                                    set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 goto tree_11;
                                         }
                                 } else {
@@ -1068,36 +2141,36 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                 if (img_row_prev_prev[c] > 0) {
                                                                 NODE_64:
                                                                         if (img_row_prev_prev[c - 1] > 0) {
-                                                                                img_labels_row[c] =
-                                                                                    img_labels_row_prev_prev[c + 2];
+                                                                                img_labels_row[c >> 1] =
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1];
                                                                                 goto tree_5;
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c + 2],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto tree_5;
                                                                         }
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c + 2],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_5;
                                                                 }
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c + 2],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto tree_5;
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto tree_8;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto tree_12;
                                         }
                                 }
@@ -1108,27 +2181,27 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                         if (img_row_prev_prev[c] > 0) {
                                                         NODE_69:
                                                                 if (img_row_prev_prev[c - 1] > 0) {
-                                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                         goto tree_6;
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[c >> 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_6;
                                                                 }
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[c >> 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto tree_6;
                                                         }
                                                 } else {
                                                         goto NODE_61;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto tree_7;
                                         }
                                 } else {
@@ -1145,28 +2218,28 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         }
                         if (img_row[c] > 0) {
                                 if (img_row_prev[c + 1] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                         goto tree_11;
                                 } else {
                                         if (img_row[c + 1] > 0) {
                                         NODE_72:
                                                 if (img_row_prev[c + 2] > 0) {
                                                         if (img_row_prev_prev[c + 1] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c + 2];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) + 1];
                                                                 goto tree_5;
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c + 2],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto tree_5;
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto tree_8;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto tree_12;
                                         }
                                 }
@@ -1174,25 +2247,25 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 if (img_row_fol[c] > 0) {
                                         if (img_row[c + 1] > 0) {
                                                 if (img_row_prev[c + 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto tree_6;
                                                 } else {
                                                         goto NODE_72;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto tree_7;
                                         }
                                 } else {
                                         if (img_row[c + 1] > 0) {
                                                 if (img_row_prev[c + 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto tree_6;
                                                 } else {
                                                         if (img_row_prev[c + 2] > 0) {
                                                                 goto NODE_5;
                                                         } else {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                 goto tree_4;
                                                         }
                                                 }
@@ -1214,15 +2287,15 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 if (img_row_prev[c + 1] > 0) {
                                 NODE_81:
                                         if (img_row_prev[c] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 goto tree_11;
                                         } else {
                                                 if (img_row_prev_prev[c] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto tree_11;
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                         goto tree_11;
                                                 }
                                         }
@@ -1234,35 +2307,35 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                         if (img_row_prev_prev[c + 1] > 0) {
                                                         NODE_86:
                                                                 if (img_row_prev[c] > 0) {
-                                                                        img_labels_row[c] =
-                                                                            img_labels_row_prev_prev[c + 2];
+                                                                        img_labels_row[c >> 1] =
+                                                                            img_labels_row_prev_prev[(c >> 1) + 1];
                                                                         goto tree_5;
                                                                 } else {
                                                                         if (img_row_prev_prev[c] > 0) {
-                                                                                img_labels_row[c] =
-                                                                                    img_labels_row_prev_prev[c + 2];
+                                                                                img_labels_row[c >> 1] =
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1];
                                                                                 goto tree_5;
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c + 2],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto tree_5;
                                                                         }
                                                                 }
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c + 2],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto tree_5;
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto tree_8;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto tree_12;
                                         }
                                 }
@@ -1273,17 +2346,17 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 if (img_row_prev[c + 1] > 0) {
                                                 NODE_91:
                                                         if (img_row_prev[c] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                 goto tree_6;
                                                         } else {
                                                                 if (img_row_prev_prev[c] > 0) {
-                                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                         goto tree_6;
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[c >> 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_6;
                                                                 }
                                                         }
@@ -1291,7 +2364,7 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                         goto NODE_84;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto tree_7;
                                         }
                                 } else {
@@ -1324,10 +2397,10 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         } else {
                                         NODE_97:
                                                 if (img_row_fol[c - 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto tree_7;
                                                 } else {
-                                                        img_labels_row[c] = label;
+                                                        img_labels_row[c >> 1] = label;
                                                         P_[label]         = label;
                                                         ((void)0);
                                                         label = label + 1;
@@ -1352,13 +2425,13 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 if (img_row_prev[c - 2] > 0) {
                                                         goto NODE_59;
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                         goto tree_11;
                                                 }
                                         } else {
-                                                img_labels_row[c] =
-                                                    set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                img_labels_row[c >> 1] =
+                                                    set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 goto tree_11;
                                         }
                                 } else {
@@ -1370,32 +2443,32 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                         if (img_row_prev[c - 2] > 0) {
                                                                                 goto NODE_64;
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c + 2],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto tree_5;
                                                                         }
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c + 2],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_5;
                                                                 }
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c + 2],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto tree_5;
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto tree_8;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto tree_12;
                                         }
                                 }
@@ -1407,24 +2480,24 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                 if (img_row_prev[c - 2] > 0) {
                                                                         goto NODE_69;
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[c >> 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_6;
                                                                 }
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[c >> 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto tree_6;
                                                         }
                                                 } else {
                                                         goto NODE_102;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto tree_7;
                                         }
                                 } else {
@@ -1442,8 +2515,8 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                                 if (img_row_fol[c - 1] > 0) {
                                         if (img_row_prev[c + 1] > 0) {
-                                                img_labels_row[c] =
-                                                    set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                img_labels_row[c >> 1] =
+                                                    set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 goto tree_11;
                                         } else {
                                                 if (img_row[c + 1] > 0) {
@@ -1473,8 +2546,8 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 if (img_row_prev_prev[c - 1] > 0) {
                                                         goto NODE_81;
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                         goto tree_11;
                                                 }
                                         } else {
@@ -1486,39 +2559,39 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                         if (img_row_prev_prev[c - 1] > 0) {
                                                                                 goto NODE_86;
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c + 2],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto tree_5;
                                                                         }
                                                                 } else {
                                                                         if (img_row_prev[c] > 0) {
                                                                         NODE_122:
                                                                                 if (img_row_prev_prev[c - 1] > 0) {
-                                                                                        img_labels_row[c] = set_union(
+                                                                                        img_labels_row[c >> 1] = set_union(
                                                                                             P_,
-                                                                                            img_labels_row_prev_prev[c +
-                                                                                                                     2],
-                                                                                            img_labels_row[c - 2]);
+                                                                                            img_labels_row_prev_prev[(c >> 1) +
+                                                                                                                     1],
+                                                                                            img_labels_row[(c >> 1) - 1]);
                                                                                         goto tree_5;
                                                                                 } else {
-                                                                                        img_labels_row[c] = set_union(
+                                                                                        img_labels_row[c >> 1] = set_union(
                                                                                             P_,
                                                                                             set_union(
                                                                                                 P_,
                                                                                                 img_labels_row_prev_prev
-                                                                                                    [c],
+                                                                                                    [c >> 1],
                                                                                                 img_labels_row_prev_prev
-                                                                                                    [c + 2]),
-                                                                                            img_labels_row[c - 2]);
+                                                                                                    [(c >> 1) + 1]),
+                                                                                            img_labels_row[(c >> 1) - 1]);
                                                                                         goto tree_5;
                                                                                 }
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c + 2],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto tree_5;
                                                                         }
                                                                 }
@@ -1526,18 +2599,18 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                 if (img_row_prev[c] > 0) {
                                                                 NODE_124:
                                                                         if (img_row_prev_prev[c - 1] > 0) {
-                                                                                img_labels_row[c] =
-                                                                                    img_labels_row_prev_prev[c];
+                                                                                img_labels_row[c >> 1] =
+                                                                                    img_labels_row_prev_prev[c >> 1];
                                                                                 goto tree_4;
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[c >> 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto tree_4;
                                                                         }
                                                                 } else {
-                                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                                         goto tree_3;
                                                                 }
                                                         }
@@ -1545,17 +2618,17 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                         if (img_row_prev[c] > 0) {
                                                         NODE_126:
                                                                 if (img_row_prev_prev[c - 1] > 0) {
-                                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                         goto tree_10;
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[c >> 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_10;
                                                                 }
                                                         } else {
-                                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                                 goto tree_9;
                                                         }
                                                 }
@@ -1572,10 +2645,10 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                 if (img_row_prev_prev[c - 1] > 0) {
                                                                         goto NODE_91;
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[c >> 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_6;
                                                                 }
                                                         } else {
@@ -1608,7 +2681,7 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         } else {
                                                 if (img_row_prev[c + 1] > 0) {
                                                         if (img_row_prev[c] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                 goto tree_11;
                                                         } else {
                                                                 goto NODE_16;
@@ -1623,22 +2696,22 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                         }
                                                                 } else {
                                                                         if (img_row_prev[c] > 0) {
-                                                                                img_labels_row[c] =
-                                                                                    img_labels_row_prev_prev[c];
+                                                                                img_labels_row[c >> 1] =
+                                                                                    img_labels_row_prev_prev[c >> 1];
                                                                                 goto tree_4;
                                                                         } else {
-                                                                                img_labels_row[c] =
-                                                                                    img_labels_row_prev_prev[c - 2];
+                                                                                img_labels_row[c >> 1] =
+                                                                                    img_labels_row_prev_prev[(c >> 1) - 1];
                                                                                 goto tree_3;
                                                                         }
                                                                 }
                                                         } else {
                                                                 if (img_row_prev[c] > 0) {
-                                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                         goto tree_10;
                                                                 } else {
-                                                                        img_labels_row[c] =
-                                                                            img_labels_row_prev_prev[c - 2];
+                                                                        img_labels_row[c >> 1] =
+                                                                            img_labels_row_prev_prev[(c >> 1) - 1];
                                                                         goto tree_9;
                                                                 }
                                                         }
@@ -1659,12 +2732,12 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                                 goto NODE_85;
                                                                         } else {
                                                                                 if (img_row_prev[c] > 0) {
-                                                                                        img_labels_row[c] =
-                                                                                            img_labels_row_prev_prev[c];
+                                                                                        img_labels_row[c >> 1] =
+                                                                                            img_labels_row_prev_prev[c >> 1];
                                                                                         goto tree_4;
                                                                                 } else {
-                                                                                        img_labels_row[c] =
-                                                                                            img_labels_row[c - 2];
+                                                                                        img_labels_row[c >> 1] =
+                                                                                            img_labels_row[(c >> 1) - 1];
                                                                                         goto tree_3;
                                                                                 }
                                                                         }
@@ -1675,14 +2748,14 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 }
                                         } else {
                                                 if (img_row_fol[c - 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto tree_7;
                                                 } else {
                                                         if (img_row[c - 1] > 0) {
-                                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                                 goto tree_7;
                                                         } else {
-                                                                img_labels_row[c] = label;
+                                                                img_labels_row[c >> 1] = label;
                                                                 P_[label]         = label;
                                                                 ((void)0);
                                                                 label = label + 1;
@@ -1708,8 +2781,8 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 if (img_row_prev[c - 2] > 0) {
                                                         goto NODE_116;
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                         goto tree_11;
                                                 }
                                         } else {
@@ -1720,10 +2793,10 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                         if (img_row_prev[c - 2] > 0) {
                                                                                 goto NODE_120;
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c + 2],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto tree_5;
                                                                         }
                                                                 } else {
@@ -1731,22 +2804,22 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                                 if (img_row_prev[c - 2] > 0) {
                                                                                         goto NODE_122;
                                                                                 } else {
-                                                                                        img_labels_row[c] = set_union(
+                                                                                        img_labels_row[c >> 1] = set_union(
                                                                                             P_,
                                                                                             set_union(
                                                                                                 P_,
                                                                                                 img_labels_row_prev_prev
-                                                                                                    [c],
+                                                                                                    [c >> 1],
                                                                                                 img_labels_row_prev_prev
-                                                                                                    [c + 2]),
-                                                                                            img_labels_row[c - 2]);
+                                                                                                    [(c >> 1) + 1]),
+                                                                                            img_labels_row[(c >> 1) - 1]);
                                                                                         goto tree_5;
                                                                                 }
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c + 2],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto tree_5;
                                                                         }
                                                                 }
@@ -1755,14 +2828,14 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                         if (img_row_prev[c - 2] > 0) {
                                                                                 goto NODE_124;
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[c >> 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto tree_4;
                                                                         }
                                                                 } else {
-                                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                                         goto tree_3;
                                                                 }
                                                         }
@@ -1771,14 +2844,14 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                 if (img_row_prev[c - 2] > 0) {
                                                                         goto NODE_126;
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[c >> 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_10;
                                                                 }
                                                         } else {
-                                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                                 goto tree_9;
                                                         }
                                                 }
@@ -1794,10 +2867,10 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                 if (img_row_prev[c - 2] > 0) {
                                                                         goto NODE_131;
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[c >> 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto tree_6;
                                                                 }
                                                         } else {
@@ -1817,9 +2890,9 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                         NODE_168:
                                 if (img_row_prev[c] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                 } else {
-                                        img_labels_row[c] = label;
+                                        img_labels_row[c >> 1] = label;
                                         P_[label]         = label;
                                         ((void)0);
                                         label = label + 1;
@@ -1827,12 +2900,12 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         } else {
                         NODE_169:
                                 if (img_row_fol[c] > 0) {
-                                        img_labels_row[c] = label;
+                                        img_labels_row[c >> 1] = label;
                                         P_[label]         = label;
                                         ((void)0);
                                         label = label + 1;
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                 }
                         }
                         continue;
@@ -1840,12 +2913,12 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                         NODE_170:
                                 if (img_row_prev[c] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                 } else {
                                         if (img_row_prev[c - 1] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) - 1];
                                         } else {
-                                                img_labels_row[c] = label;
+                                                img_labels_row[c >> 1] = label;
                                                 P_[label]         = label;
                                                 ((void)0);
                                                 label = label + 1;
@@ -1859,29 +2932,29 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                         NODE_172:
                                 if (img_row_prev[c - 1] > 0) {
-                                        img_labels_row[c] =
-                                            set_union(P_, img_labels_row_prev_prev[c - 2], img_labels_row[c - 2]);
+                                        img_labels_row[c >> 1] =
+                                            set_union(P_, img_labels_row_prev_prev[(c >> 1) - 1], img_labels_row[(c >> 1) - 1]);
                                 } else {
                                 NODE_173:
                                         if (img_row_prev[c] > 0) {
-                                                img_labels_row[c] =
-                                                    set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                img_labels_row[c >> 1] =
+                                                    set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         }
                                 }
                         } else {
                         NODE_174:
                                 if (img_row_fol[c] > 0) {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                 }
                         }
                         continue;
                 break_0_3:
                         if (img_row[c] > 0) {
-                                img_labels_row[c] = img_labels_row[c - 2];
+                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                         } else {
                                 goto NODE_174;
                         }
@@ -1898,15 +2971,15 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 if (img_row_fol[c] > 0) {
                                 NODE_177:
                                         if (img_row_fol[c - 1] > 0) {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         } else {
-                                                img_labels_row[c] = label;
+                                                img_labels_row[c >> 1] = label;
                                                 P_[label]         = label;
                                                 ((void)0);
                                                 label = label + 1;
                                         }
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                 }
                         }
                         continue;
@@ -1928,13 +3001,13 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         if (img_row_prev[c] > 0) {
                                         NODE_181:
                                                 if (img_row_prev_prev[c - 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         }
                                 } else {
                                         goto NODE_168;
@@ -1946,16 +3019,16 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                 break_0_7:
                         if (img_row[c] > 0) {
                                 if (img_row[c - 1] > 0) {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 } else {
                                         if (img_row_fol[c - 1] > 0) {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         } else {
                                         NODE_184:
                                                 if (img_row_prev[c] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) - 1];
                                                 }
                                         }
                                 }
@@ -1963,19 +3036,19 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 if (img_row_fol[c] > 0) {
                                 NODE_186:
                                         if (img_row_fol[c - 1] > 0) {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         } else {
                                                 if (img_row[c - 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 } else {
-                                                        img_labels_row[c] = label;
+                                                        img_labels_row[c >> 1] = label;
                                                         P_[label]         = label;
                                                         ((void)0);
                                                         label = label + 1;
                                                 }
                                         }
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                 }
                         }
                         continue;
@@ -1988,11 +3061,11 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 if (img_row_prev[c - 2] > 0) {
                                                         goto NODE_181;
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         }
                                 } else {
                                         goto NODE_168;
@@ -2005,7 +3078,7 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                         NODE_191:
                                 if (img_row_prev[c + 1] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                 } else {
                                         goto NODE_168;
                                 }
@@ -2015,7 +3088,7 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         if (img_row[c + 1] > 0) {
                                                 goto NODE_191;
                                         } else {
-                                                img_labels_row[c] = label;
+                                                img_labels_row[c >> 1] = label;
                                                 P_[label]         = label;
                                                 ((void)0);
                                                 label = label + 1;
@@ -2027,12 +3100,12 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         } else {
                                         NODE_195:
                                                 if (img_row_fol[c + 1] > 0) {
-                                                        img_labels_row[c] = label;
+                                                        img_labels_row[c >> 1] = label;
                                                         P_[label]         = label;
                                                         ((void)0);
                                                         label = label + 1;
                                                 } else {
-                                                        img_labels_row[c] = 0;
+                                                        img_labels_row[c >> 1] = 0;
                                                 }
                                         }
                                 }
@@ -2043,20 +3116,20 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         NODE_196:
                                 if (img_row_prev[c + 1] > 0) {
                                         if (img_row_prev[c] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                         } else {
                                                 if (img_row_prev[c - 1] > 0) {
                                                 NODE_199:
                                                         if (img_row_prev_prev[c] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c - 2],
-                                                                              img_labels_row_prev_prev[c]);
+                                                                              img_labels_row_prev_prev[(c >> 1) - 1],
+                                                                              img_labels_row_prev_prev[c >> 1]);
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 }
                                         }
                                 } else {
@@ -2071,26 +3144,26 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         NODE_200:
                                 if (img_row_prev[c + 1] > 0) {
                                         if (img_row_prev[c] > 0) {
-                                                img_labels_row[c] =
-                                                    set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                img_labels_row[c >> 1] =
+                                                    set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                         } else {
                                                 if (img_row_prev[c - 1] > 0) {
                                                         if (img_row_prev_prev[c] > 0) {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[c >> 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
                                                                               set_union(P_,
-                                                                                        img_labels_row_prev_prev[c - 2],
-                                                                                        img_labels_row_prev_prev[c]),
-                                                                              img_labels_row[c - 2]);
+                                                                                        img_labels_row_prev_prev[(c >> 1) - 1],
+                                                                                        img_labels_row_prev_prev[c >> 1]),
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 }
                                         }
                                 } else {
@@ -2101,13 +3174,13 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         if (img_row[c + 1] > 0) {
                                         NODE_206:
                                                 if (img_row_prev[c + 1] > 0) {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 } else {
                                                         goto NODE_173;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         }
                                 } else {
                                         goto NODE_194;
@@ -2118,25 +3191,25 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                         NODE_207:
                                 if (img_row_prev[c + 1] > 0) {
-                                        img_labels_row[c] =
-                                            set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                        img_labels_row[c >> 1] =
+                                            set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                 } else {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 }
                         } else {
                                 if (img_row_fol[c] > 0) {
                                         if (img_row[c + 1] > 0) {
                                                 goto NODE_207;
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         }
                                 } else {
                                 NODE_210:
                                         if (img_row[c + 1] > 0) {
                                                 if (img_row_prev[c + 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 } else {
-                                                        img_labels_row[c] = label;
+                                                        img_labels_row[c >> 1] = label;
                                                         P_[label]         = label;
                                                         ((void)0);
                                                         label = label + 1;
@@ -2154,18 +3227,18 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         if (img_row_prev_prev[c] > 0) {
                                                 goto NODE_181;
                                         } else {
-                                                img_labels_row[c] =
-                                                    set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                img_labels_row[c >> 1] =
+                                                    set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                         }
                                 } else {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 }
                         } else {
                                 if (img_row_fol[c] > 0) {
                                         if (img_row[c + 1] > 0) {
                                                 goto NODE_212;
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         }
                                 } else {
                                         goto NODE_210;
@@ -2176,20 +3249,20 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                         NODE_216:
                                 if (img_row_prev[c + 1] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                 } else {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 }
                         } else {
                                 if (img_row_fol[c] > 0) {
                                         if (img_row[c + 1] > 0) {
                                                 goto NODE_216;
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         }
                                 } else {
                                         if (img_row[c + 1] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                         } else {
                                                 goto NODE_195;
                                         }
@@ -2202,24 +3275,24 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 if (img_row_prev[c + 1] > 0) {
                                 NODE_221:
                                         if (img_row_prev[c] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                         } else {
                                                 if (img_row_prev_prev[c] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 }
                                         }
                                 } else {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 }
                         } else {
                                 if (img_row_fol[c] > 0) {
                                         if (img_row[c + 1] > 0) {
                                                 goto NODE_220;
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         }
                                 } else {
                                         goto NODE_194;
@@ -2258,18 +3331,18 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         if (img_row_prev_prev[c] > 0) {
                                                 goto NODE_190;
                                         } else {
-                                                img_labels_row[c] =
-                                                    set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                img_labels_row[c >> 1] =
+                                                    set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                         }
                                 } else {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 }
                         } else {
                                 if (img_row_fol[c] > 0) {
                                         if (img_row[c + 1] > 0) {
                                                 goto NODE_229;
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                         }
                                 } else {
                                         goto NODE_210;
@@ -2292,8 +3365,8 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 if (img_row_prev_prev[c - 1] > 0) {
                                                         goto NODE_221;
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 }
                                         } else {
                                                 goto NODE_180;
@@ -2323,7 +3396,7 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         } else {
                                                 if (img_row_prev[c + 1] > 0) {
                                                         if (img_row_prev[c] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         } else {
                                                                 goto NODE_199;
                                                         }
@@ -2343,11 +3416,11 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                         goto NODE_221;
                                                                 } else {
                                                                         if (img_row_prev[c] > 0) {
-                                                                                img_labels_row[c] =
-                                                                                    img_labels_row_prev_prev[c];
+                                                                                img_labels_row[c >> 1] =
+                                                                                    img_labels_row_prev_prev[c >> 1];
                                                                         } else {
-                                                                                img_labels_row[c] =
-                                                                                    img_labels_row[c - 2];
+                                                                                img_labels_row[c >> 1] =
+                                                                                    img_labels_row[(c >> 1) - 1];
                                                                         }
                                                                 }
                                                         } else {
@@ -2370,8 +3443,8 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 if (img_row_prev[c - 2] > 0) {
                                                         goto NODE_235;
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 }
                                         } else {
                                                 goto NODE_189;
@@ -2394,11 +3467,11 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                 }
                 if (oh & 1) {
                         const int            r                        = oh - 1;
-                        const uint8_t* const img_row                  = img_pad + r * w_pad + 2;
-                        const uint8_t* const img_row_prev             = img_row - w_pad;
-                        const uint8_t* const img_row_prev_prev        = img_row_prev - w_pad;
-                        int* const           img_labels_row           = labels_pad + r * w_pad + 2;
-                        int* const           img_labels_row_prev_prev = img_labels_row - 2 * w_pad;
+                        const uint8_t* const img_row                  = img + (size_t)r * ow;
+                        const uint8_t* const img_row_prev             = img_row - ow;
+                        const uint8_t* const img_row_prev_prev        = img_row_prev - ow;
+                        int* const           img_labels_row           = block_labels + (size_t)(r >> 1) * bw;
+                        int* const           img_labels_row_prev_prev = img_labels_row - bw;
                         int                  c                        = -2;
                 ll_tree_0:
                         if ((c += 2) >= w - 2) {
@@ -2410,7 +3483,7 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         }
                         if (img_row[c] > 0) {
                                 if (img_row_prev[c + 1] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                         goto ll_tree_6;
                                 } else {
                                         if (img_row[c + 1] > 0) {
@@ -2419,26 +3492,26 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                         if (img_row_prev[c] > 0) {
                                                         NODE_279:
                                                                 if (img_row_prev_prev[c + 1] > 0) {
-                                                                        img_labels_row[c] =
-                                                                            img_labels_row_prev_prev[c + 2];
+                                                                        img_labels_row[c >> 1] =
+                                                                            img_labels_row_prev_prev[(c >> 1) + 1];
                                                                         goto ll_tree_4;
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c],
-                                                                                      img_labels_row_prev_prev[c + 2]);
+                                                                                      img_labels_row_prev_prev[c >> 1],
+                                                                                      img_labels_row_prev_prev[(c >> 1) + 1]);
                                                                         goto ll_tree_4;
                                                                 }
                                                         } else {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c + 2];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) + 1];
                                                                 goto ll_tree_4;
                                                         }
                                                 } else {
                                                         if (img_row_prev[c] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                 goto ll_tree_3;
                                                         } else {
-                                                                img_labels_row[c] = label;
+                                                                img_labels_row[c >> 1] = label;
                                                                 P_[label]         = label;
                                                                 ((void)0);
                                                                 label = label + 1;
@@ -2447,10 +3520,10 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 }
                                         } else {
                                                 if (img_row_prev[c] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto ll_tree_0;
                                                 } else {
-                                                        img_labels_row[c] = label;
+                                                        img_labels_row[c >> 1] = label;
                                                         P_[label]         = label;
                                                         ((void)0);
                                                         label = label + 1;
@@ -2462,13 +3535,13 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         NODE_282:
                                 if (img_row[c + 1] > 0) {
                                         if (img_row_prev[c + 1] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 goto ll_tree_5;
                                         } else {
                                                 goto NODE_277;
                                         }
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                         goto ll_tree_1;
                                 }
                         }
@@ -2483,23 +3556,23 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                                 if (img_row_prev[c + 1] > 0) {
                                         if (img_row_prev[c] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 goto ll_tree_6;
                                         } else {
                                                 if (img_row_prev[c - 1] > 0) {
                                                 NODE_287:
                                                         if (img_row_prev_prev[c] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                 goto ll_tree_6;
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c - 2],
-                                                                              img_labels_row_prev_prev[c]);
+                                                                              img_labels_row_prev_prev[(c >> 1) - 1],
+                                                                              img_labels_row_prev_prev[c >> 1]);
                                                                 goto ll_tree_6;
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto ll_tree_6;
                                                 }
                                         }
@@ -2513,43 +3586,43 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                 NODE_292:
                                                                         if (img_row_prev_prev[c + 1] > 0) {
                                                                                 if (img_row_prev_prev[c] > 0) {
-                                                                                        img_labels_row[c] =
-                                                                                            img_labels_row_prev_prev[c +
-                                                                                                                     2];
+                                                                                        img_labels_row[c >> 1] =
+                                                                                            img_labels_row_prev_prev[(c >> 1) +
+                                                                                                                     1];
                                                                                         goto ll_tree_4;
                                                                                 } else {
-                                                                                        img_labels_row[c] = set_union(
+                                                                                        img_labels_row[c >> 1] = set_union(
                                                                                             P_,
-                                                                                            img_labels_row_prev_prev[c -
-                                                                                                                     2],
+                                                                                            img_labels_row_prev_prev[(c >> 1) -
+                                                                                                                     1],
                                                                                             img_labels_row_prev_prev
-                                                                                                [c + 2]);
+                                                                                                [(c >> 1) + 1]);
                                                                                         goto ll_tree_4;
                                                                                 }
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c - 2],
-                                                                                    img_labels_row_prev_prev[c + 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) - 1],
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1]);
                                                                                 goto ll_tree_4;
                                                                         }
                                                                 } else {
-                                                                        img_labels_row[c] =
-                                                                            img_labels_row_prev_prev[c + 2];
+                                                                        img_labels_row[c >> 1] =
+                                                                            img_labels_row_prev_prev[(c >> 1) + 1];
                                                                         goto ll_tree_4;
                                                                 }
                                                         }
                                                 } else {
                                                         if (img_row_prev[c] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                 goto ll_tree_3;
                                                         } else {
                                                                 if (img_row_prev[c - 1] > 0) {
-                                                                        img_labels_row[c] =
-                                                                            img_labels_row_prev_prev[c - 2];
+                                                                        img_labels_row[c >> 1] =
+                                                                            img_labels_row_prev_prev[(c >> 1) - 1];
                                                                         goto ll_tree_2;
                                                                 } else {
-                                                                        img_labels_row[c] = label;
+                                                                        img_labels_row[c >> 1] = label;
                                                                         P_[label]         = label;
                                                                         ((void)0);
                                                                         label = label + 1;
@@ -2559,14 +3632,14 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 }
                                         } else {
                                                 if (img_row_prev[c] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto ll_tree_0;
                                                 } else {
                                                         if (img_row_prev[c - 1] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c - 2];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) - 1];
                                                                 goto ll_tree_0;
                                                         } else {
-                                                                img_labels_row[c] = label;
+                                                                img_labels_row[c >> 1] = label;
                                                                 P_[label]         = label;
                                                                 ((void)0);
                                                                 label = label + 1;
@@ -2588,21 +3661,21 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         }
                         if (img_row[c] > 0) {
                                 if (img_row_prev[c + 1] > 0) {
-                                        img_labels_row[c] =
-                                            set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                        img_labels_row[c >> 1] =
+                                            set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                         goto ll_tree_6;
                                 } else {
                                         if (img_row[c + 1] > 0) {
                                                 if (img_row_prev[c + 2] > 0) {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c + 2], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[(c >> 1) + 1], img_labels_row[(c >> 1) - 1]);
                                                         goto ll_tree_4;
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto ll_tree_7;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto ll_tree_0;
                                         }
                                 }
@@ -2610,14 +3683,14 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         NODE_301:
                                 if (img_row[c + 1] > 0) {
                                         if (img_row_prev[c + 1] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 goto ll_tree_5;
                                         } else {
                                                 if (img_row_prev[c + 2] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c + 2];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) + 1];
                                                         goto ll_tree_4;
                                                 } else {
-                                                        img_labels_row[c] = label;
+                                                        img_labels_row[c >> 1] = label;
                                                         P_[label]         = label;
                                                         ((void)0);
                                                         label = label + 1;
@@ -2625,7 +3698,7 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 }
                                         }
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                         goto ll_tree_1;
                                 }
                         }
@@ -2642,17 +3715,17 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         if (img_row_prev_prev[c] > 0) {
                                         NODE_306:
                                                 if (img_row_prev_prev[c - 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto ll_tree_6;
                                                 } else {
-                                                        img_labels_row[c] = set_union(P_,
-                                                                                      img_labels_row_prev_prev[c - 2],
-                                                                                      img_labels_row_prev_prev[c]);
+                                                        img_labels_row[c >> 1] = set_union(P_,
+                                                                                      img_labels_row_prev_prev[(c >> 1) - 1],
+                                                                                      img_labels_row_prev_prev[c >> 1]);
                                                         goto ll_tree_6;
                                                 }
                                         } else {
-                                                img_labels_row[c] =
-                                                    set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                img_labels_row[c >> 1] =
+                                                    set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 goto ll_tree_6;
                                         }
                                 } else {
@@ -2662,36 +3735,36 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                 if (img_row_prev_prev[c] > 0) {
                                                                 NODE_311:
                                                                         if (img_row_prev_prev[c - 1] > 0) {
-                                                                                img_labels_row[c] =
-                                                                                    img_labels_row_prev_prev[c + 2];
+                                                                                img_labels_row[c >> 1] =
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1];
                                                                                 goto ll_tree_4;
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c + 2],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto ll_tree_4;
                                                                         }
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c + 2],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto ll_tree_4;
                                                                 }
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c + 2],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto ll_tree_4;
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto ll_tree_7;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto ll_tree_0;
                                         }
                                 }
@@ -2708,45 +3781,45 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         }
                         if (img_row[c] > 0) {
                                 if (img_row_prev[c + 1] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                         goto ll_tree_6;
                                 } else {
                                         if (img_row[c + 1] > 0) {
                                                 if (img_row_prev[c + 2] > 0) {
                                                         if (img_row_prev_prev[c + 1] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c + 2];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) + 1];
                                                                 goto ll_tree_4;
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c + 2],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto ll_tree_4;
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto ll_tree_7;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto ll_tree_0;
                                         }
                                 }
                         } else {
                                 if (img_row[c + 1] > 0) {
                                         if (img_row_prev[c + 1] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 goto ll_tree_5;
                                         } else {
                                                 if (img_row_prev[c + 2] > 0) {
                                                         goto NODE_279;
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto ll_tree_3;
                                                 }
                                         }
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                         goto ll_tree_1;
                                 }
                         }
@@ -2762,15 +3835,15 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         NODE_319:
                                 if (img_row_prev[c + 1] > 0) {
                                         if (img_row_prev[c] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 goto ll_tree_6;
                                         } else {
                                                 if (img_row_prev_prev[c] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto ll_tree_6;
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                         goto ll_tree_6;
                                                 }
                                         }
@@ -2779,35 +3852,35 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 if (img_row_prev[c + 2] > 0) {
                                                         if (img_row_prev_prev[c + 1] > 0) {
                                                                 if (img_row_prev[c] > 0) {
-                                                                        img_labels_row[c] =
-                                                                            img_labels_row_prev_prev[c + 2];
+                                                                        img_labels_row[c >> 1] =
+                                                                            img_labels_row_prev_prev[(c >> 1) + 1];
                                                                         goto ll_tree_4;
                                                                 } else {
                                                                         if (img_row_prev_prev[c] > 0) {
-                                                                                img_labels_row[c] =
-                                                                                    img_labels_row_prev_prev[c + 2];
+                                                                                img_labels_row[c >> 1] =
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1];
                                                                                 goto ll_tree_4;
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c + 2],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto ll_tree_4;
                                                                         }
                                                                 }
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c + 2],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto ll_tree_4;
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto ll_tree_7;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto ll_tree_0;
                                         }
                                 }
@@ -2828,7 +3901,7 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 } else {
                                         if (img_row_prev[c + 1] > 0) {
                                                 if (img_row_prev[c] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         goto ll_tree_6;
                                                 } else {
                                                         goto NODE_287;
@@ -2843,20 +3916,20 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                 }
                                                         } else {
                                                                 if (img_row_prev[c] > 0) {
-                                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                         goto ll_tree_3;
                                                                 } else {
-                                                                        img_labels_row[c] =
-                                                                            img_labels_row_prev_prev[c - 2];
+                                                                        img_labels_row[c >> 1] =
+                                                                            img_labels_row_prev_prev[(c >> 1) - 1];
                                                                         goto ll_tree_2;
                                                                 }
                                                         }
                                                 } else {
                                                         if (img_row_prev[c] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                                 goto ll_tree_0;
                                                         } else {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c - 2];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) - 1];
                                                                 goto ll_tree_0;
                                                         }
                                                 }
@@ -2879,13 +3952,13 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 if (img_row_prev[c - 2] > 0) {
                                                         goto NODE_306;
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                         goto ll_tree_6;
                                                 }
                                         } else {
-                                                img_labels_row[c] =
-                                                    set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                img_labels_row[c >> 1] =
+                                                    set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 goto ll_tree_6;
                                         }
                                 } else {
@@ -2896,32 +3969,32 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                                         if (img_row_prev[c - 2] > 0) {
                                                                                 goto NODE_311;
                                                                         } else {
-                                                                                img_labels_row[c] = set_union(
+                                                                                img_labels_row[c >> 1] = set_union(
                                                                                     P_,
-                                                                                    img_labels_row_prev_prev[c + 2],
-                                                                                    img_labels_row[c - 2]);
+                                                                                    img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                    img_labels_row[(c >> 1) - 1]);
                                                                                 goto ll_tree_4;
                                                                         }
                                                                 } else {
-                                                                        img_labels_row[c] =
+                                                                        img_labels_row[c >> 1] =
                                                                             set_union(P_,
-                                                                                      img_labels_row_prev_prev[c + 2],
-                                                                                      img_labels_row[c - 2]);
+                                                                                      img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                                      img_labels_row[(c >> 1) - 1]);
                                                                         goto ll_tree_4;
                                                                 }
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c + 2],
-                                                                              img_labels_row[c - 2]);
+                                                                              img_labels_row_prev_prev[(c >> 1) + 1],
+                                                                              img_labels_row[(c >> 1) - 1]);
                                                                 goto ll_tree_4;
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row[c - 2];
+                                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                         goto ll_tree_7;
                                                 }
                                         } else {
-                                                img_labels_row[c] = img_labels_row[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                                 goto ll_tree_0;
                                         }
                                 }
@@ -2932,64 +4005,64 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                         NODE_343:
                                 if (img_row_prev[c] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                 } else {
-                                        img_labels_row[c] = label;
+                                        img_labels_row[c >> 1] = label;
                                         P_[label]         = label;
                                         ((void)0);
                                         label = label + 1;
                                 }
                         } else {
-                                img_labels_row[c] = 0;
+                                img_labels_row[c >> 1] = 0;
                         }
                         goto ll_end;
                 ll_break_0_1:
                         if (img_row[c] > 0) {
                         NODE_344:
                                 if (img_row_prev[c] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                 } else {
                                         if (img_row_prev[c - 1] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) - 1];
                                         } else {
-                                                img_labels_row[c] = label;
+                                                img_labels_row[c >> 1] = label;
                                                 P_[label]         = label;
                                                 ((void)0);
                                                 label = label + 1;
                                         }
                                 }
                         } else {
-                                img_labels_row[c] = 0;
+                                img_labels_row[c >> 1] = 0;
                         }
                         goto ll_end;
                 ll_break_0_2:
                         if (img_row[c] > 0) {
-                                img_labels_row[c] = img_labels_row[c - 2];
+                                img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                         } else {
-                                img_labels_row[c] = 0;
+                                img_labels_row[c >> 1] = 0;
                         }
                         goto ll_end;
                 ll_break_0_3:
                         if (img_row[c] > 0) {
                                 if (img_row[c - 1] > 0) {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 } else {
                                 NODE_347:
                                         if (img_row_prev[c] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                         } else {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c - 2];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[(c >> 1) - 1];
                                         }
                                 }
                         } else {
-                                img_labels_row[c] = 0;
+                                img_labels_row[c >> 1] = 0;
                         }
                         goto ll_end;
                 ll_break_1_0:
                         if (img_row[c] > 0) {
                         NODE_348:
                                 if (img_row_prev[c + 1] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                 } else {
                                         goto NODE_343;
                                 }
@@ -2998,7 +4071,7 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 if (img_row[c + 1] > 0) {
                                         goto NODE_348;
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                 }
                         }
                         goto ll_end;
@@ -3006,20 +4079,20 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         if (img_row[c] > 0) {
                                 if (img_row_prev[c + 1] > 0) {
                                         if (img_row_prev[c] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                         } else {
                                                 if (img_row_prev[c - 1] > 0) {
                                                 NODE_353:
                                                         if (img_row_prev_prev[c] > 0) {
-                                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                         } else {
-                                                                img_labels_row[c] =
+                                                                img_labels_row[c >> 1] =
                                                                     set_union(P_,
-                                                                              img_labels_row_prev_prev[c - 2],
-                                                                              img_labels_row_prev_prev[c]);
+                                                                              img_labels_row_prev_prev[(c >> 1) - 1],
+                                                                              img_labels_row_prev_prev[c >> 1]);
                                                         }
                                                 } else {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 }
                                         }
                                 } else {
@@ -3032,24 +4105,24 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                 ll_break_1_2:
                         if (img_row[c] > 0) {
                                 if (img_row_prev[c + 1] > 0) {
-                                        img_labels_row[c] =
-                                            set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                        img_labels_row[c >> 1] =
+                                            set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                 } else {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 }
                         } else {
                         NODE_355:
                                 if (img_row[c + 1] > 0) {
                                         if (img_row_prev[c + 1] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                         } else {
-                                                img_labels_row[c] = label;
+                                                img_labels_row[c >> 1] = label;
                                                 P_[label]         = label;
                                                 ((void)0);
                                                 label = label + 1;
                                         }
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                 }
                         }
                         goto ll_end;
@@ -3059,18 +4132,18 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                         if (img_row_prev_prev[c] > 0) {
                                         NODE_359:
                                                 if (img_row_prev_prev[c - 1] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 } else {
-                                                        img_labels_row[c] = set_union(P_,
-                                                                                      img_labels_row_prev_prev[c - 2],
-                                                                                      img_labels_row_prev_prev[c]);
+                                                        img_labels_row[c >> 1] = set_union(P_,
+                                                                                      img_labels_row_prev_prev[(c >> 1) - 1],
+                                                                                      img_labels_row_prev_prev[c >> 1]);
                                                 }
                                         } else {
-                                                img_labels_row[c] =
-                                                    set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                img_labels_row[c >> 1] =
+                                                    set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                         }
                                 } else {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 }
                         } else {
                                 goto NODE_355;
@@ -3079,15 +4152,15 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                 ll_break_1_4:
                         if (img_row[c] > 0) {
                                 if (img_row_prev[c + 1] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                 } else {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 }
                         } else {
                                 if (img_row[c + 1] > 0) {
-                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                 } else {
-                                        img_labels_row[c] = 0;
+                                        img_labels_row[c >> 1] = 0;
                                 }
                         }
                         goto ll_end;
@@ -3096,17 +4169,17 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                         NODE_362:
                                 if (img_row_prev[c + 1] > 0) {
                                         if (img_row_prev[c] > 0) {
-                                                img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                         } else {
                                                 if (img_row_prev_prev[c] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 }
                                         }
                                 } else {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 }
                         } else {
                                 goto NODE_349;
@@ -3119,7 +4192,7 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                 } else {
                                         if (img_row_prev[c + 1] > 0) {
                                                 if (img_row_prev[c] > 0) {
-                                                        img_labels_row[c] = img_labels_row_prev_prev[c];
+                                                        img_labels_row[c >> 1] = img_labels_row_prev_prev[c >> 1];
                                                 } else {
                                                         goto NODE_353;
                                                 }
@@ -3138,15 +4211,15 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
                                                 if (img_row_prev[c - 2] > 0) {
                                                         goto NODE_359;
                                                 } else {
-                                                        img_labels_row[c] = set_union(
-                                                            P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                        img_labels_row[c >> 1] = set_union(
+                                                            P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                                 }
                                         } else {
-                                                img_labels_row[c] =
-                                                    set_union(P_, img_labels_row_prev_prev[c], img_labels_row[c - 2]);
+                                                img_labels_row[c >> 1] =
+                                                    set_union(P_, img_labels_row_prev_prev[c >> 1], img_labels_row[(c >> 1) - 1]);
                                         }
                                 } else {
-                                        img_labels_row[c] = img_labels_row[c - 2];
+                                        img_labels_row[c >> 1] = img_labels_row[(c >> 1) - 1];
                                 }
                         } else {
                                 goto NODE_355;
@@ -3158,52 +4231,1019 @@ static int spaghetti8_label(const uint8_t* img, int width, int height, int* labe
         int k = 1;
         flattenLParallel(P_, firstLabel, label - firstLabel, &k);
         const int nLabels = k;
-        for (int r = 0; r < oh; r += 2) {
-                for (int c = 0; c < ow; c += 2) {
-                        int anchor = labels_pad[r * w_pad + 2 + c];
-                        int root   = (anchor > 0) ? P_[anchor] : 0;
-                        if (img_pad[r * w_pad + 2 + c]) {
-                                labels_out[r * ow + c] = root;
-                        } else {
-                                labels_out[r * ow + c] = 0;
-                        }
-                        if (c + 1 < ow) {
-                                if (img_pad[r * w_pad + 2 + c + 1]) {
-                                        labels_out[r * ow + c + 1] = root;
-                                } else {
-                                        labels_out[r * ow + c + 1] = 0;
-                                }
-                        }
-                        if (r + 1 < oh) {
-                                if (img_pad[(r + 1) * w_pad + 2 + c]) {
-                                        labels_out[(r + 1) * ow + c] = root;
-                                } else {
-                                        labels_out[(r + 1) * ow + c] = 0;
-                                }
-                        }
-                        if (r + 1 < oh && c + 1 < ow) {
-                                if (img_pad[(r + 1) * w_pad + 2 + c + 1]) {
-                                        labels_out[(r + 1) * ow + c + 1] = root;
-                                } else {
-                                        labels_out[(r + 1) * ow + c + 1] = 0;
-                                }
-                        }
-                }
+        // Nothing is written when the count does not fit the requested format,
+        // the caller reports the overflow.
+        if (label_format == CD_LABELS_UINT16 && nLabels - 1 > UINT16_MAX) return nLabels;
+        BoxStats* stats = (BoxStats*)buffer_reserve(&ctx->stats, (size_t)nLabels * sizeof(BoxStats));
+        if (!stats) return 0;
+        box_stats_init(stats, nLabels, ow, oh);
+        if (label_format == CD_LABELS_UINT16) {
+                expand_block_labels_u16(img, ow, oh, block_labels, P_, (uint16_t*)labels_out, &ctx->extras, stats);
+        } else {
+                expand_block_labels_s32(img, ow, oh, block_labels, P_, (int*)labels_out, &ctx->extras, stats);
         }
-        free(P_);
-        free(img_pad);
-        free(labels_pad);
         return nLabels;
 }
 
-static int cmp_area_desc(const void* a, const void* b) {
-        const CDCircle* ca = (const CDCircle*)a;
-        const CDCircle* cb = (const CDCircle*)b;
-        if (ca->area < cb->area) return 1;
+// Run-length pipeline. Every stage below touches runs only, so after the
+// threshold its cost follows the number of run boundaries, not width*height.
+
+static inline int has_zero_byte(uint64_t v) {
+        return ((v - 0x0101010101010101ull) & ~v & 0x8080808080808080ull) != 0;
+}
+
+// Appends the foreground runs of one mask row to out, returns how many.
+static int row_to_runs(const uint8_t* row, int width, Run* out) {
+        int n = 0;
+        int x = 0;
+        while (x < width) {
+                for (; x + 8 <= width; x += 8) {
+                        uint64_t word;
+                        memcpy(&word, row + x, 8);
+                        if (word) break;
+                }
+                while (x < width && !row[x]) ++x;
+                if (x >= width) break;
+                const int x0 = x;
+                for (; x + 8 <= width; x += 8) {
+                        uint64_t word;
+                        memcpy(&word, row + x, 8);
+                        if (has_zero_byte(word)) break;
+                }
+                while (x < width && row[x]) ++x;
+                out[n].x0 = x0;
+                out[n].x1 = x;
+                ++n;
+        }
+        return n;
+}
+
+// Worst-case number of runs in one row.
+static inline int max_row_runs(int width) {
+        return width / 2 + 1;
+}
+
+// Strict sub-runs of the foreground runs of row, appended to out.
+static int strict_runs(const uint8_t* row, const Run* runs, int num_runs, Run* out) {
+        int n = 0;
+        for (int i = 0; i < num_runs; ++i) {
+                for (int x = runs[i].x0; x < runs[i].x1;) {
+                        if (row[x] != CD_MASK_STRICT) {
+                                ++x;
+                                continue;
+                        }
+                        const int x0 = x;
+                        while (x < runs[i].x1 && row[x] == CD_MASK_STRICT) ++x;
+                        out[n].x0 = x0;
+                        out[n].x1 = x;
+                        ++n;
+                }
+        }
+        return n;
+}
+
+// Thresholds into dst; with hysteresis the strict pixels also go to strict.
+// uv is the region table, NULL for the box test.
+static int threshold_runs(CDContext* ctx, const CDConfig* cfg, const UVTable* uv, RunImage* dst, RunImage* strict) {
+        const int width  = cfg->width;
+        const int height = cfg->height;
+        // Mask row, then the threshold scratch.
+        uint8_t* row   = (uint8_t*)buffer_reserve(&ctx->row_scratch, (size_t)width + threshold_scratch_bytes(width));
+        int*     rows  = (int*)buffer_reserve(&dst->rows, ((size_t)height + 1) * sizeof(int));
+        int*     srows = strict ? (int*)buffer_reserve(&strict->rows, ((size_t)height + 1) * sizeof(int)) : NULL;
+        if (!row || !rows || (strict && !srows)) return 0;
+        Threshold t;
+        threshold_init(&t, cfg, uv, 0, row + (((size_t)width + 15) & ~(size_t)15));
+        int n  = 0;
+        int sn = 0;
+        for (int j = 0; j < height; ++j) {
+                Run* runs = (Run*)buffer_grow(&dst->runs, ((size_t)n + max_row_runs(width)) * sizeof(Run));
+                if (!runs) return 0;
+                threshold_row(&t, j, row);
+                rows[j]         = n;
+                const int count = row_to_runs(row, width, runs + n);
+                if (strict) {
+                        Run* sruns = (Run*)buffer_grow(&strict->runs, ((size_t)sn + max_row_runs(width)) * sizeof(Run));
+                        if (!sruns) return 0;
+                        srows[j] = sn;
+                        sn += strict_runs(row, runs + n, count, sruns + sn);
+                }
+                n += count;
+        }
+        rows[height] = n;
+        if (strict) srows[height] = sn;
+        return 1;
+}
+
+static int intersect_runs(const Run* a, int na, const Run* b, int nb, Run* out) {
+        int i = 0, j = 0, n = 0;
+        while (i < na && j < nb) {
+                const int x0 = a[i].x0 > b[j].x0 ? a[i].x0 : b[j].x0;
+                const int x1 = a[i].x1 < b[j].x1 ? a[i].x1 : b[j].x1;
+                if (x0 < x1) {
+                        out[n].x0 = x0;
+                        out[n].x1 = x1;
+                        ++n;
+                }
+                if (a[i].x1 < b[j].x1) {
+                        ++i;
+                } else {
+                        ++j;
+                }
+        }
+        return n;
+}
+
+// Union of up to three sorted run lists, merging runs that overlap or touch.
+static int union_runs3(const Run* a, int na, const Run* b, int nb, const Run* c, int nc, Run* out) {
+        int i = 0, j = 0, k = 0, n = 0;
+        while (i < na || j < nb || k < nc) {
+                const Run* next = NULL;
+                if (i < na) next = &a[i];
+                if (j < nb && (!next || b[j].x0 < next->x0)) next = &b[j];
+                if (k < nc && (!next || c[k].x0 < next->x0)) next = &c[k];
+                if (next == &a[i]) {
+                        ++i;
+                } else if (next == &b[j]) {
+                        ++j;
+                } else {
+                        ++k;
+                }
+                if (n > 0 && next->x0 <= out[n - 1].x1) {
+                        if (next->x1 > out[n - 1].x1) out[n - 1].x1 = next->x1;
+                } else {
+                        out[n++] = *next;
+                }
+        }
+        return n;
+}
+
+// Run-length equivalents of erode3x3_cross/dilate3x3_cross, producing exactly
+// the same foreground (including the cleared border of the erosion).
+static int morph_runs_pass(const RunImage* src, int width, int height, int dilate, Run* scratch, RunImage* dst) {
+        const int* srows = (const int*)src->rows.data;
+        const Run* sruns = (const Run*)src->runs.data;
+        int*       rows  = (int*)buffer_reserve(&dst->rows, ((size_t)height + 1) * sizeof(int));
+        if (!rows) return 0;
+        const int row_cap = max_row_runs(width);
+        Run*      grown   = scratch;
+        Run*      partial = scratch + row_cap;
+        int       n       = 0;
+        for (int y = 0; y < height; ++y) {
+                Run* runs = (Run*)buffer_grow(&dst->runs, ((size_t)n + row_cap) * sizeof(Run));
+                if (!runs) return 0;
+                rows[y] = n;
+                const Run* cur  = sruns + srows[y];
+                const int  ncur = srows[y + 1] - srows[y];
+                const Run* up   = y > 0 ? sruns + srows[y - 1] : NULL;
+                const int  nup  = y > 0 ? srows[y] - srows[y - 1] : 0;
+                const Run* dn   = y + 1 < height ? sruns + srows[y + 1] : NULL;
+                const int  ndn  = y + 1 < height ? srows[y + 2] - srows[y + 1] : 0;
+                int        ng   = 0;
+                if (dilate) {
+                        for (int i = 0; i < ncur; ++i) {
+                                grown[i].x0 = cur[i].x0 > 0 ? cur[i].x0 - 1 : 0;
+                                grown[i].x1 = cur[i].x1 < width ? cur[i].x1 + 1 : width;
+                        }
+                        n += union_runs3(grown, ncur, up, nup, dn, ndn, runs + n);
+                } else {
+                        if (y == 0 || y == height - 1) continue;
+                        for (int i = 0; i < ncur; ++i) {
+                                if (cur[i].x1 - cur[i].x0 < 3) continue;
+                                grown[ng].x0 = cur[i].x0 + 1;
+                                grown[ng].x1 = cur[i].x1 - 1;
+                                ++ng;
+                        }
+                        const int np = intersect_runs(grown, ng, up, nup, partial);
+                        n += intersect_runs(partial, np, dn, ndn, runs + n);
+                }
+        }
+        rows[height] = n;
+        return 1;
+}
+
+static int morph_open_close_runs(CDContext* ctx, RunImage* img, int width, int height) {
+        Run* scratch = (Run*)buffer_reserve(&ctx->row_scratch, 2u * (size_t)max_row_runs(width) * sizeof(Run));
+        if (!scratch) return 0;
+        return morph_runs_pass(img, width, height, 0, scratch, &ctx->run_tmp) &&
+               morph_runs_pass(&ctx->run_tmp, width, height, 1, scratch, img) &&
+               morph_runs_pass(img, width, height, 1, scratch, &ctx->run_tmp) &&
+               morph_runs_pass(&ctx->run_tmp, width, height, 0, scratch, img);
+}
+
+// Hysteresis for the run pipeline: flags every label whose runs meet a strict
+// run. The strict runs went through the same open/close as the mask, which
+// is what the grey-level morphology does to the strict level of a dense mask.
+static void
+mark_strict_runs(const RunImage* ri, const int* run_labels, const RunImage* strict, int height, BoxStats* stats) {
+        const int* rows  = (const int*)ri->rows.data;
+        const Run* runs  = (const Run*)ri->runs.data;
+        const int* srows = (const int*)strict->rows.data;
+        const Run* sruns = (const Run*)strict->runs.data;
+        for (int y = 0; y < height; ++y) {
+                int i = rows[y];
+                for (int k = srows[y]; k < srows[y + 1]; ++k) {
+                        while (i < rows[y + 1] && runs[i].x1 <= sruns[k].x0) ++i;
+                        if (i < rows[y + 1] && runs[i].x0 < sruns[k].x1) stats[run_labels[i]].strict = 1;
+                }
+        }
+}
+
+// CCL over runs: runs on consecutive rows are joined when they overlap, or
+// for 8-connectivity also when they touch diagonally, and when run_class is
+// given only if their classes match. On return run_labels holds each run's
+// final label; the result is the number of labels including background.
+static int label_runs(CDContext* ctx, const RunImage* ri, const uint8_t* run_class, int height, int connectivity) {
+        const int  diag  = connectivity == 4 ? 0 : 1;
+        const int* rows  = (const int*)ri->rows.data;
+        const Run* runs  = (const Run*)ri->runs.data;
+        const int  total = rows[height];
+        int*       P_    = (int*)buffer_reserve(&ctx->parents, ((size_t)total + 2) * sizeof(int));
+        int*       lab   = (int*)buffer_reserve(&ctx->run_labels, ((size_t)total + 1) * sizeof(int));
+        if (!P_ || !lab) return 0;
+        P_[0] = 0;
+        for (int y = 0; y < height; ++y) {
+                int       j    = y > 0 ? rows[y - 1] : rows[y];
+                const int jend = rows[y];
+                for (int i = rows[y]; i < rows[y + 1]; ++i) {
+                        const int l = i + 1;
+                        P_[l]       = l;
+                        lab[i]      = l;
+                        while (j < jend && runs[j].x1 + diag <= runs[i].x0) ++j;
+                        for (int k = j; k < jend && runs[k].x0 < runs[i].x1 + diag; ++k) {
+                                if (!run_class || run_class[k] == run_class[i]) set_union(P_, lab[k], l);
+                        }
+                }
+        }
+        int k = 1;
+        flattenLParallel(P_, 1, total, &k);
+        for (int i = 0; i < total; ++i) lab[i] = P_[lab[i]];
+        return k;
+}
+
+// Stats straight from the runs; links for hole counting are the run overlaps
+// of label_runs, walked again here.
+static void box_stats_runs(
+    const RunImage* ri, const int* run_labels, int width, int height, const StatsExtras* ex, BoxStats* stats) {
+        const int* rows = (const int*)ri->rows.data;
+        const Run* runs = (const Run*)ri->runs.data;
+        for (int y = 0; y < height; ++y) {
+                int       j    = y > 0 ? rows[y - 1] : rows[y];
+                const int jend = rows[y];
+                for (int i = rows[y]; i < rows[y + 1]; ++i) {
+                        BoxStats* s = &stats[run_labels[i]];
+                        box_stats_add_run(s, y, runs[i].x0, runs[i].x1);
+                        if (ex->luma) box_stats_add_luma(s, y, runs[i].x0, runs[i].x1, ex->luma + (size_t)y * width);
+                        const int diag = ex->euler;
+                        s->euler += 1;
+                        while (j < jend && runs[j].x1 + diag <= runs[i].x0) ++j;
+                        for (int k = j; k < jend && runs[k].x0 < runs[i].x1 + diag; ++k) {
+                                if (!ex->run_class || ex->run_class[k] == ex->run_class[i]) s->euler -= 1;
+                        }
+                        if (ex->run_class) s->cls = ex->run_class[i];
+                        if (ex->strict_mask && !s->strict) {
+                                const uint8_t* m = ex->strict_mask + (size_t)y * width;
+                                s->strict        = memchr(m + runs[i].x0, CD_MASK_STRICT, runs[i].x1 - runs[i].x0) != NULL;
+                        }
+                }
+        }
+}
+
+// Optional dense outputs of the run pipeline; these are the only full-frame
+// writes it does. The mask uses the dense encoding: with strict runs given the
+// foreground is CD_MASK_LOOSE and the strict runs, a subset of it, are
+// CD_MASK_STRICT; without them every foreground pixel is CD_MASK_STRICT.
+static void paint_runs(const RunImage* ri,
+                       const int*      run_labels,
+                       const RunImage* strict,
+                       int             width,
+                       int             height,
+                       uint8_t*        mask,
+                       void*           labels,
+                       int             label_format) {
+        const int*    rows = (const int*)ri->rows.data;
+        const Run*    runs = (const Run*)ri->runs.data;
+        const size_t  n    = (size_t)width * height;
+        const uint8_t fg   = strict ? CD_MASK_LOOSE : CD_MASK_STRICT;
+        if (mask) memset(mask, 0, n);
+        if (labels) memset(labels, 0, n * (label_format == CD_LABELS_UINT16 ? sizeof(uint16_t) : sizeof(int)));
+        for (int y = 0; y < height; ++y) {
+                for (int i = rows[y]; i < rows[y + 1]; ++i) {
+                        const size_t off = (size_t)y * width + runs[i].x0;
+                        const int    len = runs[i].x1 - runs[i].x0;
+                        if (mask) memset(mask + off, fg, (size_t)len);
+                        if (!labels) continue;
+                        if (label_format == CD_LABELS_UINT16) {
+                                uint16_t* dst = (uint16_t*)labels + off;
+                                for (int x = 0; x < len; ++x) dst[x] = (uint16_t)run_labels[i];
+                        } else {
+                                int* dst = (int*)labels + off;
+                                for (int x = 0; x < len; ++x) dst[x] = run_labels[i];
+                        }
+                }
+        }
+        if (!mask || !strict) return;
+        const int* srows = (const int*)strict->rows.data;
+        const Run* sruns = (const Run*)strict->runs.data;
+        for (int y = 0; y < height; ++y) {
+                uint8_t* row = mask + (size_t)y * width;
+                for (int k = srows[y]; k < srows[y + 1]; ++k)
+                        memset(row + sruns[k].x0, CD_MASK_STRICT, (size_t)(sruns[k].x1 - sruns[k].x0));
+        }
+}
+
+// Provisional labels of the pixel-based labelers. 32-bit output is labelled
+// in place. 16-bit output is scanned in a two-row int window and each finished
+// row is stored narrowed into labels_out, so no int frame is buffered; once a
+// provisional label no longer fits 16 bits the stores stop and overflow is set.
+typedef struct {
+        int*      out32;  // 32-bit output, NULL for 16-bit
+        uint16_t* out16;  // 16-bit output, NULL for 32-bit
+        int*      window; // 2 * width ints, 16-bit output only
+        int       width;
+        int       overflow;
+} ProvRows;
+
+static int prov_rows_init(CDContext* ctx, ProvRows* pr, void* labels_out, int label_format, int width) {
+        const int narrow = label_format == CD_LABELS_UINT16;
+        pr->out32        = narrow ? NULL : (int*)labels_out;
+        pr->out16        = narrow ? (uint16_t*)labels_out : NULL;
+        pr->window       = narrow ? (int*)buffer_reserve(&ctx->provisional, 2 * (size_t)width * sizeof(int)) : NULL;
+        pr->width        = width;
+        pr->overflow     = 0;
+        return !narrow || pr->window;
+}
+
+// Provisional label row y; rows y and y - 1 are valid together.
+static inline int* prov_row(const ProvRows* pr, int y) {
+        if (pr->out32) return pr->out32 + (size_t)y * pr->width;
+        return pr->window + (size_t)(y & 1) * pr->width;
+}
+
+// Stores finished row y of a 16-bit scan; every label in it is below next_label.
+static void prov_store(ProvRows* pr, int y, int next_label) {
+        if (pr->out32 || pr->overflow) return;
+        if (next_label - 1 > UINT16_MAX) {
+                pr->overflow = 1;
+                return;
+        }
+        const int* src = prov_row(pr, y);
+        uint16_t*  dst = pr->out16 + (size_t)y * pr->width;
+        for (int x = 0; x < pr->width; ++x) dst[x] = (uint16_t)src[x];
+}
+
+// Final pass of the pixel-based labelers: maps every provisional label in
+// labels_out through P and folds each finished row into the stats.
+static void relabel_rows(const int*         P,
+                         int                width,
+                         int                height,
+                         void*              labels_out,
+                         int                label_format,
+                         const StatsExtras* ex,
+                         BoxStats*          stats) {
+        for (int y = 0; y < height; ++y) {
+                if (label_format == CD_LABELS_UINT16) {
+                        uint16_t* dst = (uint16_t*)labels_out + (size_t)y * width;
+                        for (int x = 0; x < width; ++x) dst[x] = (uint16_t)P[dst[x]];
+                        box_stats_row_u16(dst, y > 0 ? dst - width : NULL, width, y, ex, stats);
+                } else {
+                        int* dst = (int*)labels_out + (size_t)y * width;
+                        for (int x = 0; x < width; ++x) dst[x] = P[dst[x]];
+                        box_stats_row_s32(dst, y > 0 ? dst - width : NULL, width, y, ex, stats);
+                }
+        }
+}
+
+// Flattens P over [1, next_label) and runs relabel_rows, leaving the stats in
+// ctx->stats. Returns the number of labels including background, or -1 when
+// the 16-bit provisional labels overflowed although the final ones fit; the
+// caller then relabels with a labeler that has no such limit.
+static int finish_pixel_labels(CDContext* ctx,
+                               int*       P_,
+                               int        next_label,
+                               int        overflow,
+                               int        width,
+                               int        height,
+                               void*      labels_out,
+                               int        label_format) {
+        int k = 1;
+        flattenLParallel(P_, 1, next_label - 1, &k);
+        const int nLabels = k;
+        if (label_format == CD_LABELS_UINT16 && nLabels - 1 > UINT16_MAX) return nLabels;
+        if (overflow) return -1;
+        BoxStats* stats = (BoxStats*)buffer_reserve(&ctx->stats, (size_t)nLabels * sizeof(BoxStats));
+        if (!stats) return 0;
+        box_stats_init(stats, nLabels, width, height);
+        relabel_rows(P_, width, height, labels_out, label_format, &ctx->extras, stats);
+        return nLabels;
+}
+
+// Pixel-based 8-connectivity labeling with the SAUF decision tree over the
+// already-scanned neighbours p q r (row above) and s (left).
+static int sauf8_label(CDContext* ctx, const uint8_t* img, int width, int height, void* labels_out, int label_format) {
+        const int max_labels = ((height + 1) / 2) * ((width + 1) / 2) + 1;
+        int*      P_         = (int*)buffer_reserve(&ctx->parents, ((size_t)max_labels + 1) * sizeof(int));
+        ProvRows  pr;
+        if (!P_ || !prov_rows_init(ctx, &pr, labels_out, label_format, width)) return 0;
+        P_[0]     = 0;
+        int label = 1;
+        for (int y = 0; y < height; ++y) {
+                const uint8_t* row   = img + (size_t)y * width;
+                const uint8_t* prev  = y > 0 ? row - width : NULL;
+                int*           lrow  = prov_row(&pr, y);
+                const int*     lprev = y > 0 ? prov_row(&pr, y - 1) : NULL;
+                for (int x = 0; x < width; ++x) {
+                        if (!row[x]) {
+                                lrow[x] = 0;
+                                continue;
+                        }
+                        const int q = y > 0 && prev[x];
+                        const int r = y > 0 && x + 1 < width && prev[x + 1];
+                        const int p = y > 0 && x > 0 && prev[x - 1];
+                        const int s = x > 0 && row[x - 1];
+                        if (q) {
+                                lrow[x] = lprev[x];
+                        } else if (r) {
+                                if (p) {
+                                        lrow[x] = set_union(P_, lprev[x - 1], lprev[x + 1]);
+                                } else if (s) {
+                                        lrow[x] = set_union(P_, lrow[x - 1], lprev[x + 1]);
+                                } else {
+                                        lrow[x] = lprev[x + 1];
+                                }
+                        } else if (p) {
+                                lrow[x] = lprev[x - 1];
+                        } else if (s) {
+                                lrow[x] = lrow[x - 1];
+                        } else {
+                                lrow[x]   = label;
+                                P_[label] = label;
+                                label     = label + 1;
+                        }
+                }
+                prov_store(&pr, y, label);
+        }
+        return finish_pixel_labels(ctx, P_, label, pr.overflow, width, height, labels_out, label_format);
+}
+
+// 4-connectivity labeling as a small decision forest: the state after each
+// pixel records whether its left neighbour s and the upper-left p are
+// foreground. With s and p both set, s, p and the pixel above already share a
+// set, so the only union happens in the state where p is background.
+static int spaghetti4_label(CDContext* ctx, const uint8_t* img, int width, int height, void* labels_out, int label_format) {
+        const size_t max_labels = ((size_t)width * height + 1) / 2 + 1;
+        int*         P_         = (int*)buffer_reserve(&ctx->parents, (max_labels + 1) * sizeof(int));
+        ProvRows     pr;
+        if (!P_ || !prov_rows_init(ctx, &pr, labels_out, label_format, width)) return 0;
+        P_[0]     = 0;
+        int label = 1;
+
+        // First line: only the left neighbour exists.
+        {
+                const uint8_t* row  = img;
+                int*           lrow = prov_row(&pr, 0);
+                for (int x = 0; x < width; ++x) {
+                        if (!row[x]) {
+                                lrow[x] = 0;
+                        } else if (x > 0 && row[x - 1]) {
+                                lrow[x] = lrow[x - 1];
+                        } else {
+                                lrow[x]   = label;
+                                P_[label] = label;
+                                label     = label + 1;
+                        }
+                }
+        }
+
+        for (int y = 1; y < height; ++y) {
+                const uint8_t* row   = img + (size_t)y * width;
+                const uint8_t* prev  = row - width;
+                int*           lrow  = prov_row(&pr, y);
+                const int*     lprev = prov_row(&pr, y - 1);
+                int            x     = 0;
+                prov_store(&pr, y - 1, label);
+
+        tree_bg: // s background
+                if (x == width) continue;
+                if (!row[x]) {
+                        lrow[x] = 0;
+                        ++x;
+                        const int skip = skip_zero_columns3(row, row, row, x, width);
+                        if (skip > x) {
+                                memset(lrow + x, 0, (size_t)(skip - x) * sizeof(int));
+                                x = skip;
+                        }
+                        goto tree_bg;
+                }
+                if (prev[x]) {
+                        lrow[x] = lprev[x];
+                        ++x;
+                        goto tree_fg_p1;
+                }
+                lrow[x]   = label;
+                P_[label] = label;
+                label     = label + 1;
+                ++x;
+                goto tree_fg_p0;
+
+        tree_fg_p0: // s foreground, p background
+                if (x == width) continue;
+                if (!row[x]) {
+                        lrow[x] = 0;
+                        ++x;
+                        goto tree_bg;
+                }
+                if (prev[x]) {
+                        lrow[x] = set_union(P_, lprev[x], lrow[x - 1]);
+                        ++x;
+                        goto tree_fg_p1;
+                }
+                lrow[x] = lrow[x - 1];
+                ++x;
+                goto tree_fg_p0;
+
+        tree_fg_p1: // s and p foreground
+                if (x == width) continue;
+                if (!row[x]) {
+                        lrow[x] = 0;
+                        ++x;
+                        goto tree_bg;
+                }
+                lrow[x] = lrow[x - 1];
+                ++x;
+                if (prev[x - 1]) goto tree_fg_p1;
+                goto tree_fg_p0;
+        }
+        prov_store(&pr, height - 1, label);
+        return finish_pixel_labels(ctx, P_, label, pr.overflow, width, height, labels_out, label_format);
+}
+
+static int mask_to_runs(const uint8_t* mask, int width, int height, RunImage* dst) {
+        int* rows = (int*)buffer_reserve(&dst->rows, ((size_t)height + 1) * sizeof(int));
+        if (!rows) return 0;
+        int n = 0;
+        for (int y = 0; y < height; ++y) {
+                Run* runs = (Run*)buffer_grow(&dst->runs, ((size_t)n + max_row_runs(width)) * sizeof(Run));
+                if (!runs) return 0;
+                rows[y] = n;
+                n += row_to_runs(mask + (size_t)y * width, width, runs + n);
+        }
+        rows[height] = n;
+        return 1;
+}
+
+static BoxStats* stats_from_runs(CDContext* ctx, const RunImage* ri, int width, int height, int num_components) {
+        BoxStats* stats = (BoxStats*)buffer_reserve(&ctx->stats, (size_t)num_components * sizeof(BoxStats));
+        if (!stats) return NULL;
+        box_stats_init(stats, num_components, width, height);
+        box_stats_runs(ri, (const int*)ctx->run_labels.data, width, height, &ctx->extras, stats);
+        return stats;
+}
+
+// Samples every eighth row and picks the run labeler when those rows average
+// fewer than one run per 64 pixels of width (runs * 64 < rows * width), i.e. a
+// few long runs; everything else goes to Spaghetti.
+static int choose_ccl(CDContext* ctx, const uint8_t* mask, int width, int height) {
+        Run* scratch = (Run*)buffer_reserve(&ctx->row_scratch, (size_t)max_row_runs(width) * sizeof(Run));
+        if (!scratch) return CD_CCL_SPAGHETTI;
+        int64_t runs    = 0;
+        int64_t sampled = 0;
+        for (int y = 0; y < height; y += 8, ++sampled) runs += row_to_runs(mask + (size_t)y * width, width, scratch);
+        return runs * 64 < sampled * width ? CD_CCL_RUNS : CD_CCL_SPAGHETTI;
+}
+
+// Labels a dense mask with the configured algorithm. All of them write the
+// same partition to labels_out and leave identical BoxStats in ctx->stats;
+// only the numbering of the labels differs.
+static int label_mask(CDContext*     ctx,
+                      int            ccl,
+                      int            connectivity,
+                      const uint8_t* mask,
+                      int            width,
+                      int            height,
+                      void*          labels_out,
+                      int            label_format) {
+        if (ccl == CD_CCL_AUTO) ccl = choose_ccl(ctx, mask, width, height);
+        // The pixel labelers return -1 when their 16-bit provisional labels ran
+        // out; the run and block labelers need fewer provisional labels.
+        if (connectivity == 4 && ccl != CD_CCL_RUNS) {
+                const int n = spaghetti4_label(ctx, mask, width, height, labels_out, label_format);
+                if (n >= 0) return n;
+                ccl = CD_CCL_RUNS;
+        } else if (ccl == CD_CCL_SAUF) {
+                const int n = sauf8_label(ctx, mask, width, height, labels_out, label_format);
+                if (n >= 0) return n;
+                ccl = CD_CCL_SPAGHETTI;
+        }
+        switch (ccl) {
+                case CD_CCL_RUNS: {
+                        if (!mask_to_runs(mask, width, height, &ctx->run_mask)) return 0;
+                        const int n = label_runs(ctx, &ctx->run_mask, NULL, height, connectivity);
+                        if (n == 0 || (label_format == CD_LABELS_UINT16 && n - 1 > UINT16_MAX)) return n;
+                        paint_runs(&ctx->run_mask,
+                                   (const int*)ctx->run_labels.data,
+                                   NULL,
+                                   width,
+                                   height,
+                                   NULL,
+                                   labels_out,
+                                   label_format);
+                        return stats_from_runs(ctx, &ctx->run_mask, width, height, n) ? n : 0;
+                }
+                default: return spaghetti8_label(ctx, mask, width, height, labels_out, label_format);
+        }
+}
+
+// Runs of one class each for label_class_mask. A pixel left with several
+// class bits by the closing goes to its lowest class.
+static int mask_to_class_runs(const uint8_t* mask, int width, int height, RunImage* dst, CDBuffer* run_class) {
+        int* rows = (int*)buffer_reserve(&dst->rows, ((size_t)height + 1) * sizeof(int));
+        if (!rows) return 0;
+        int n = 0;
+        for (int y = 0; y < height; ++y) {
+                Run*     runs = (Run*)buffer_grow(&dst->runs, ((size_t)n + width) * sizeof(Run));
+                uint8_t* cls  = (uint8_t*)buffer_grow(run_class, (size_t)n + width);
+                if (!runs || !cls) return 0;
+                const uint8_t* row = mask + (size_t)y * width;
+                rows[y]            = n;
+                for (int x = 0; x < width;) {
+                        for (; x + 8 <= width; x += 8) {
+                                uint64_t word;
+                                memcpy(&word, row + x, 8);
+                                if (word) break;
+                        }
+                        while (x < width && !row[x]) ++x;
+                        if (x >= width) break;
+                        const int lowest = row[x] & -row[x];
+                        const int x0     = x;
+                        while (x < width && row[x] && (row[x] & -row[x]) == lowest) ++x;
+                        runs[n].x0 = x0;
+                        runs[n].x1 = x;
+                        cls[n]     = (uint8_t)__builtin_ctz((unsigned)lowest);
+                        ++n;
+                }
+        }
+        rows[height] = n;
+        return 1;
+}
+
+// Labels a multi-class mask so that components never cross classes; the
+// stats also carry each component's class. Same contract as label_mask.
+static int label_class_mask(CDContext*     ctx,
+                            int            connectivity,
+                            const uint8_t* mask,
+                            int            width,
+                            int            height,
+                            void*          labels_out,
+                            int            label_format) {
+        if (!mask_to_class_runs(mask, width, height, &ctx->run_mask, &ctx->run_class)) return 0;
+        const uint8_t* run_class = (const uint8_t*)ctx->run_class.data;
+        const int      n         = label_runs(ctx, &ctx->run_mask, run_class, height, connectivity);
+        if (n == 0 || (label_format == CD_LABELS_UINT16 && n - 1 > UINT16_MAX)) return n;
+        paint_runs(&ctx->run_mask,
+                   (const int*)ctx->run_labels.data,
+                   NULL,
+                   width,
+                   height,
+                   NULL,
+                   labels_out,
+                   label_format);
+        ctx->extras.run_class = run_class;
+        const BoxStats* stats = stats_from_runs(ctx, &ctx->run_mask, width, height, n);
+        ctx->extras.run_class = NULL;
+        return stats ? n : 0;
+}
+
+// Folds the stats of a disjoint component into dst. Holes add up, so the
+// Euler numbers add up minus one.
+static void box_stats_merge(BoxStats* dst, const BoxStats* src) {
+        if (src->minx < dst->minx) dst->minx = src->minx;
+        if (src->miny < dst->miny) dst->miny = src->miny;
+        if (src->maxx > dst->maxx) dst->maxx = src->maxx;
+        if (src->maxy > dst->maxy) dst->maxy = src->maxy;
+        dst->area += src->area;
+        dst->sumx += src->sumx;
+        dst->sumy += src->sumy;
+        dst->sumxx += src->sumxx;
+        dst->sumyy += src->sumyy;
+        dst->sumxy += src->sumxy;
+        dst->sumY += src->sumY;
+        dst->sumYx += src->sumYx;
+        dst->sumYy += src->sumYy;
+        dst->euler += src->euler - 1;
+        dst->seen |= src->seen;
+        dst->strict |= src->strict;
+}
+
+// Shape from the central second moments, each widened by 1/12 for the pixel
+// extent. roundness compares the polar moment with that of a disc of the same
+// area: 1 for a disc, lower for ellipses, rings and ragged blobs.
+typedef struct {
+        double eccentricity;
+        double orientation; // major axis angle in radians, x towards y
+        double roundness;
+} Shape;
+
+static Shape box_stats_shape(const BoxStats* s) {
+        const double a   = (double)s->area;
+        const double mx  = (double)s->sumx / a;
+        const double my  = (double)s->sumy / a;
+        const double m20 = (double)s->sumxx / a - mx * mx + 1.0 / 12.0;
+        const double m02 = (double)s->sumyy / a - my * my + 1.0 / 12.0;
+        const double m11 = (double)s->sumxy / a - mx * my;
+        const double h   = 0.5 * (m20 + m02);
+        const double d   = sqrt(0.25 * (m20 - m02) * (m20 - m02) + m11 * m11);
+        Shape        sh;
+        sh.eccentricity = h + d > 0.0 ? sqrt(fmax(0.0, 1.0 - (h - d) / (h + d))) : 0.0;
+        sh.orientation  = 0.5 * atan2(2.0 * m11, m20 - m02);
+        sh.roundness    = a / (2.0 * M_PI * (m20 + m02));
+        return sh;
+}
+
+static int cmp_area_desc(const void* a, const void* b) {
+        const CDCircle* ca = &((const CDCircleEx*)a)->circle;
+        const CDCircle* cb = &((const CDCircleEx*)b)->circle;
+        if (ca->area < cb->area) return 1;
         if (ca->area > cb->area) return -1;
         return 0;
 }
 
+static inline int label_at(const void* labels, int label_format, size_t i) {
+        return label_format == CD_LABELS_UINT16 ? ((const uint16_t*)labels)[i] : ((const int*)labels)[i];
+}
+
+// Moore-neighbour tracing of the outer boundary of label, starting from its
+// first pixel on the bbox top row. Directions are Freeman codes (0 = east,
+// counter-clockwise on screen); the trace stops when it is back at the start
+// about to repeat its first move (Jacob's criterion). Returns the number of
+// points written, or 0 when the boundary does not fit in cap points: a
+// truncated contour is never reported.
+static int trace_contour(
+    const void* labels, int label_format, int width, int height, const BoxStats* s, int label, CDPoint* pts, int cap) {
+        static const int dx[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+        static const int dy[8] = {0, -1, -1, -1, 0, 1, 1, 1};
+        if (cap <= 0) return 0;
+        const int sy = s->miny;
+        int       sx = s->minx;
+        while (label_at(labels, label_format, (size_t)sy * width + sx) != label) ++sx;
+
+        int x = sx, y = sy, d = 7, first = -1, n = 0;
+        for (;;) {
+                const int start = (d & 1) ? (d + 6) & 7 : (d + 7) & 7;
+                int       nd    = -1;
+                for (int i = 0; i < 8; ++i) {
+                        const int k  = (start + i) & 7;
+                        const int nx = x + dx[k];
+                        const int ny = y + dy[k];
+                        if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+                        if (label_at(labels, label_format, (size_t)ny * width + nx) == label) {
+                                nd = k;
+                                break;
+                        }
+                }
+                if (nd >= 0 && first >= 0 && x == sx && y == sy && nd == first) break;
+                if (n == cap) return 0;
+                pts[n].x = x;
+                pts[n].y = y;
+                ++n;
+                if (nd < 0) break;
+                if (first < 0) first = nd;
+                x += dx[nd];
+                y += dy[nd];
+                d = nd;
+        }
+        return n;
+}
+
+// Midpoints of the crack edges between the traced boundary pixels and their
+// background 4-neighbours, i.e. points on the pixel-exact outline of the label
+// rather than pixel centres half a pixel inside it. A pixel the trace visits
+// twice contributes its edges twice. Writes at most 4 * n (x, y) pairs.
+static int crack_edge_points(
+    const void* labels, int label_format, int width, int height, int label, const CDPoint* px, int n, double* pts) {
+        static const int dx[4] = {1, 0, -1, 0};
+        static const int dy[4] = {0, -1, 0, 1};
+        int              m     = 0;
+        for (int i = 0; i < n; ++i) {
+                for (int k = 0; k < 4; ++k) {
+                        const int nx = px[i].x + dx[k];
+                        const int ny = px[i].y + dy[k];
+                        if (nx >= 0 && ny >= 0 && nx < width && ny < height &&
+                            label_at(labels, label_format, (size_t)ny * width + nx) == label)
+                                continue;
+                        pts[2 * m]     = px[i].x + 0.5 * dx[k];
+                        pts[2 * m + 1] = px[i].y + 0.5 * dy[k];
+                        ++m;
+                }
+        }
+        return m;
+}
+
+// Solves the 3x3 system A x = b by Cramer's rule; returns 0 when singular.
+static int solve3(double A[3][3], const double b[3], double x[3]) {
+        const double det = A[0][0] * (A[1][1] * A[2][2] - A[1][2] * A[2][1]) -
+                           A[0][1] * (A[1][0] * A[2][2] - A[1][2] * A[2][0]) +
+                           A[0][2] * (A[1][0] * A[2][1] - A[1][1] * A[2][0]);
+        if (fabs(det) < 1e-12) return 0;
+        for (int k = 0; k < 3; ++k) {
+                double M[3][3];
+                for (int r = 0; r < 3; ++r) {
+                        for (int c = 0; c < 3; ++c) M[r][c] = c == k ? b[r] : A[r][c];
+                }
+                x[k] = (M[0][0] * (M[1][1] * M[2][2] - M[1][2] * M[2][1]) -
+                        M[0][1] * (M[1][0] * M[2][2] - M[1][2] * M[2][0]) +
+                        M[0][2] * (M[1][0] * M[2][1] - M[1][1] * M[2][0])) /
+                       det;
+        }
+        return 1;
+}
+
+// Least-squares circle through n (x, y) pairs: algebraic Kasa fit on
+// centred coordinates as the seed, then Gauss-Newton on the geometric
+// distance. Returns 0 when the points do not determine a circle.
+static int fit_circle(const double* pts, int n, double* cx, double* cy, double* r) {
+        if (n < 5) return 0;
+        double mx = 0.0, my = 0.0;
+        for (int i = 0; i < n; ++i) {
+                mx += pts[2 * i];
+                my += pts[2 * i + 1];
+        }
+        mx /= n;
+        my /= n;
+
+        // Kasa: minimise sum (u^2 + v^2 + D u + E v + F)^2.
+        double A[3][3] = {{0}}, b[3] = {0}, sol[3];
+        for (int i = 0; i < n; ++i) {
+                const double u = pts[2 * i] - mx;
+                const double v = pts[2 * i + 1] - my;
+                const double z = u * u + v * v;
+                A[0][0] += u * u;
+                A[0][1] += u * v;
+                A[0][2] += u;
+                A[1][1] += v * v;
+                A[1][2] += v;
+                b[0] -= z * u;
+                b[1] -= z * v;
+                b[2] -= z;
+        }
+        A[1][0] = A[0][1];
+        A[2][0] = A[0][2];
+        A[2][1] = A[1][2];
+        A[2][2] = n;
+        if (!solve3(A, b, sol)) return 0;
+        double a  = -0.5 * sol[0];
+        double bb = -0.5 * sol[1];
+        double rr = a * a + bb * bb - sol[2];
+        if (rr <= 0.0) return 0;
+        rr = sqrt(rr);
+
+        for (int it = 0; it < CD_REFINE_GN_STEPS; ++it) {
+                double J[3][3] = {{0}}, g[3] = {0}, step[3];
+                for (int i = 0; i < n; ++i) {
+                        const double du = pts[2 * i] - mx - a;
+                        const double dv = pts[2 * i + 1] - my - bb;
+                        const double d  = sqrt(du * du + dv * dv);
+                        if (d < 1e-9) continue;
+                        const double j[3] = {-du / d, -dv / d, -1.0};
+                        const double res  = d - rr;
+                        for (int p = 0; p < 3; ++p) {
+                                g[p] -= j[p] * res;
+                                for (int q = 0; q < 3; ++q) J[p][q] += j[p] * j[q];
+                        }
+                }
+                if (!solve3(J, g, step)) break;
+                a += step[0];
+                bb += step[1];
+                rr += step[2];
+                if (fabs(step[0]) + fabs(step[1]) + fabs(step[2]) < 1e-4) break;
+        }
+        if (!(rr > 0.0)) return 0;
+        *cx = mx + a;
+        *cy = my + bb;
+        *r  = rr;
+        return 1;
+}
+
+static inline double sample_bilinear(const uint8_t* img, int width, double x, double y) {
+        const int    x0 = (int)x;
+        const int    y0 = (int)y;
+        const double fx = x - x0;
+        const double fy = y - y0;
+        const uint8_t* p = img + (size_t)y0 * width + x0;
+        return (1.0 - fy) * ((1.0 - fx) * p[0] + fx * p[1]) + fy * ((1.0 - fx) * p[width] + fx * p[width + 1]);
+}
+
+// Edge points from the luma plane: along rays from the moment centre, the
+// position of the strongest Y gradient between 0.5 r and 1.5 r, refined with
+// a parabola through the neighbouring samples. Returns the number of points.
+static int luma_edge_points(const CDConfig* cfg, const CDCircle* c, double* pts, int max_pts) {
+        const double step = 0.5;
+        const double lo   = 0.5 * c->r;
+        const double hi   = 1.5 * c->r + 1.0;
+        int          n    = 0;
+        for (int k = 0; k < max_pts; ++k) {
+                const double ang = 2.0 * M_PI * k / max_pts;
+                const double dx  = cos(ang);
+                const double dy  = sin(ang);
+                double       best = 0.0, best_t = lo, gm = 0.0, gp = 0.0, prev_g = 0.0;
+                int          have = 0;
+                for (double t = lo; t <= hi; t += step) {
+                        const double x0 = c->cx + dx * (t - 0.5 * step), y0 = c->cy + dy * (t - 0.5 * step);
+                        const double x1 = c->cx + dx * (t + 0.5 * step), y1 = c->cy + dy * (t + 0.5 * step);
+                        if (x0 < 0.0 || y0 < 0.0 || x1 < 0.0 || y1 < 0.0) break;
+                        if (x0 > cfg->width - 2 || x1 > cfg->width - 2) break;
+                        if (y0 > cfg->height - 2 || y1 > cfg->height - 2) break;
+                        const double g = fabs(sample_bilinear(cfg->y, cfg->width, x1, y1) -
+                                              sample_bilinear(cfg->y, cfg->width, x0, y0));
+                        if (g > best) {
+                                best   = g;
+                                best_t = t;
+                                gm     = prev_g;
+                                have   = 1;
+                        } else if (have == 1) {
+                                gp   = g;
+                                have = 2;
+                        }
+                        prev_g = g;
+                }
+                if (best < CD_REFINE_MIN_EDGE) continue;
+                // Parabolic peak only when the maximum has samples on both sides.
+                const double den = gm - 2.0 * best + gp;
+                const double off = have == 2 && best_t > lo && den < 0.0 ? 0.5 * (gm - gp) / den : 0.0;
+                const double t   = best_t + step * (off < -0.5 ? -0.5 : off > 0.5 ? 0.5 : off);
+                pts[2 * n]       = c->cx + dx * t;
+                pts[2 * n + 1]   = c->cy + dy * t;
+                ++n;
+        }
+        return n;
+}
+
+// Replaces the moment estimate of c by a least-squares fit when the fit is
+// plausible: centre inside the bbox and radius within a factor of two.
+static void refine_circle(
+    CDContext* ctx, const CDConfig* cfg, const void* labels, const BoxStats* s, int label, CDCircle* c) {
+        int     n   = 0;
+        double* pts = NULL;
+        if (cfg->refine == CD_REFINE_EDGES) {
+                if (!cfg->y) return;
+                int rays = (int)(2.0 * M_PI * c->r);
+                rays     = rays < 16 ? 16 : rays > 256 ? 256 : rays;
+                pts      = (double*)buffer_reserve(&ctx->fit_points, (size_t)rays * 2 * sizeof(double));
+                if (!pts) return;
+                n = luma_edge_points(cfg, c, pts, rays);
+        } else {
+                if (!labels) return;
+                const int cap = 4 * ((s->maxx - s->minx + 1) + (s->maxy - s->miny + 1)) + 8;
+                CDPoint*  px  = (CDPoint*)buffer_reserve(&ctx->fit_pixels, (size_t)cap * sizeof(CDPoint));
+                pts           = (double*)buffer_reserve(&ctx->fit_points, (size_t)cap * 4 * 2 * sizeof(double));
+                if (!px || !pts) return;
+                const int m = trace_contour(labels, cfg->label_format, cfg->width, cfg->height, s, label, px, cap);
+                n           = crack_edge_points(labels, cfg->label_format, cfg->width, cfg->height, label, px, m, pts);
+        }
+        double cx, cy, r;
+        if (!fit_circle(pts, n, &cx, &cy, &r)) return;
+        if (cx < s->minx || cx > s->maxx + 1 || cy < s->miny || cy > s->maxy + 1) return;
+        if (r < 0.5 * c->r || r > 2.0 * c->r) return;
+        c->cx = (float)cx;
+        c->cy = (float)cy;
+        c->r  = (float)r;
+}
+
+CDContext* cdCreateContext(void) {
+        return (CDContext*)calloc(1, sizeof(CDContext));
+}
+
+static void context_release(CDContext* ctx) {
+        buffer_release(&ctx->parents);
+        buffer_release(&ctx->block_labels);
+        buffer_release(&ctx->stats);
+        buffer_release(&ctx->run_mask.runs);
+        buffer_release(&ctx->run_mask.rows);
+        buffer_release(&ctx->run_tmp.runs);
+        buffer_release(&ctx->run_tmp.rows);
+        buffer_release(&ctx->run_strict.runs);
+        buffer_release(&ctx->run_strict.rows);
+        buffer_release(&ctx->run_class);
+        buffer_release(&ctx->run_labels);
+        buffer_release(&ctx->row_scratch);
+        buffer_release(&ctx->uv_table);
+        buffer_release(&ctx->uv_polygon);
+        buffer_release(&ctx->provisional);
+        buffer_release(&ctx->candidates);
+        buffer_release(&ctx->fit_pixels);
+        buffer_release(&ctx->fit_points);
+        buffer_release(&ctx->merge_links);
+        buffer_release(&ctx->merge_grid);
+        buffer_release(&ctx->split_map);
+        buffer_release(&ctx->split_heads);
+}
+
+void cdDestroyContext(CDContext* ctx) {
+        if (!ctx) return;
+        context_release(ctx);
+        free(ctx);
+}
+
 int detectCircles(const CDConfig* cfg,
                   CDCircle*       out,
                   int             out_cap,
@@ -3212,85 +5252,646 @@ int detectCircles(const CDConfig* cfg,
                   uint8_t*        tmp2,
                   int*            labels,
                   int*            num_components_out) {
-        if (!cfg || !out || out_cap <= 0 || !mask || !tmp1 || !tmp2 || !labels) return 0;
-        const int width  = cfg->width;
-        const int height = cfg->height;
-        if (width <= 0 || height <= 0 || (width & 1) || (height & 1)) return 0;
+        if (!cfg) return 0;
+        CDConfig local = *cfg;
+        local.label_format = CD_LABELS_INT32;
+        CDContext ctx;
+        memset(&ctx, 0, sizeof(ctx));
+        const int found = detectCirclesCtx(&ctx, &local, out, out_cap, mask, tmp1, tmp2, labels, num_components_out);
+        context_release(&ctx);
+        return found;
+}
 
-        make_color_mask_i420_full(
-            cfg->y, cfg->u, cfg->v, width, height, cfg->target_u, cfg->target_v, cfg->uv_tol, cfg->y_min, mask);
+enum {
+        COMPONENT_ACCEPTED,
+        COMPONENT_BBOX_SHAPE, // failed only the bbox aspect or extent test
+        COMPONENT_REJECTED,
+};
 
-        morph_open_close_3x3(mask, width, height, tmp1, tmp2);
+// CDConfig.accept on the cheap per-component statistics.
+static int accept_component(const CDConfig* cfg,
+                            const BoxStats* s,
+                            int             label,
+                            int             split,
+                            double          aspect,
+                            double          extent) {
+        CDComponent c;
+        c.area        = (double)s->area;
+        c.cx          = (float)((double)s->sumx / (double)s->area);
+        c.cy          = (float)((double)s->sumy / (double)s->area);
+        c.x0          = s->minx;
+        c.y0          = s->miny;
+        c.x1          = s->maxx;
+        c.y1          = s->maxy;
+        c.aspect      = (float)aspect;
+        c.extent      = (float)extent;
+        c.holes       = 1 - s->euler;
+        c.label       = label;
+        c.color_class = s->cls;
+        c.split       = split;
+        return cfg->accept(&c, cfg->accept_user) != 0;
+}
 
-        const int num_components = spaghetti8_label(mask, width, height, labels);
-        if (num_components_out) *num_components_out = num_components;
-        if (num_components <= 1) return 0;
+// Applies the CDConfig filters to one component and fills e when it passes.
+// split marks a part cut out by split_component.
+static int evaluate_component(const CDConfig*    cfg,
+                              const StatsExtras* ex,
+                              const BoxStats*    s,
+                              int                label,
+                              int                split,
+                              double             min_area,
+                              double             max_area,
+                              CDCircleEx*        e) {
+        if (!s->seen) return COMPONENT_REJECTED;
+        if (hysteresis_on(cfg) && !s->strict) return COMPONENT_REJECTED;
+        if (s->area < 4) return COMPONENT_REJECTED;
+        const int bb_w = s->maxx - s->minx + 1;
+        const int bb_h = s->maxy - s->miny + 1;
+        if (bb_w < 2 || bb_h < 2) return COMPONENT_REJECTED;
+        const double aspect    = (double)(bb_w < bb_h ? bb_w : bb_h) / (double)(bb_w > bb_h ? bb_w : bb_h);
+        const double extent    = (double)s->area / (double)(bb_w * bb_h);
+        const double area_full = (double)s->area;
+        if (cfg->accept) {
+                if (!accept_component(cfg, s, label, split, aspect, extent)) return COMPONENT_BBOX_SHAPE;
+        } else {
+                if (aspect < cfg->aspect_min) return COMPONENT_BBOX_SHAPE;
+                if (extent < cfg->extent_min) return COMPONENT_BBOX_SHAPE;
+                if (area_full < min_area || area_full > max_area) return COMPONENT_REJECTED;
+        }
+        const Shape shape = box_stats_shape(s);
+        if (cfg->eccentricity_max > 0.0 && shape.eccentricity > cfg->eccentricity_max) return COMPONENT_REJECTED;
+        if (shape.roundness < cfg->roundness_min) return COMPONENT_REJECTED;
+        const int holes = 1 - s->euler;
+        if (cfg->require_holes && holes < 1) return COMPONENT_REJECTED;
+        if (cfg->max_holes < 0 ? holes > 0 : cfg->max_holes > 0 && holes > cfg->max_holes) return COMPONENT_REJECTED;
+        const int    wl   = ex->luma && s->sumY > 0;
+        const double cx_s = wl ? (double)s->sumYx / (double)s->sumY : (double)s->sumx / (double)s->area;
+        const double cy_s = wl ? (double)s->sumYy / (double)s->sumY : (double)s->sumy / (double)s->area;
+        e->circle.cx           = (float)(cx_s);
+        e->circle.cy           = (float)(cy_s);
+        e->circle.area         = area_full;
+        e->circle.r            = (float)sqrt(area_full / M_PI);
+        e->x0                  = s->minx;
+        e->y0                  = s->miny;
+        e->x1                  = s->maxx;
+        e->y1                  = s->maxy;
+        e->label               = label;
+        e->extent              = (float)extent;
+        e->aspect              = (float)aspect;
+        e->holes               = holes;
+        e->split               = 0;
+        e->fragments           = 1;
+        e->color_class         = s->cls;
+        e->eccentricity        = (float)shape.eccentricity;
+        e->orientation         = (float)shape.orientation;
+        e->roundness           = (float)shape.roundness;
+        // 1 for an ideal disc: full roundness, square bbox, pi/4 fill.
+        const double fill = extent / (0.25 * M_PI);
+        e->score          = (float)(fmin(1.0, shape.roundness) * aspect * (fill < 1.0 ? fill : 1.0 / fill));
+        return COMPONENT_ACCEPTED;
+}
 
-        BoxStats* stats = (BoxStats*)malloc(num_components * sizeof(BoxStats));
-        if (!stats) return 0;
+// Splits a component made of touching circles, working inside its bbox only:
+// 3-4 chamfer distance transform, distance peaks at least one inscribed radius
+// apart as seeds, then a watershed flood from the seeds in decreasing distance
+// order. A region counts as a circle when it passes the filters and its radius
+// matches the inscribed radius at its seed; the parts of a half disc or a cut
+// disc are much wider than they are deep and fail the latter. Returns the
+// number written, 0 when fewer than two regions are circles.
+static int split_component(CDContext*      ctx,
+                           const CDConfig* cfg,
+                           const void*     labels,
+                           const BoxStats* s,
+                           int             label,
+                           double          min_area,
+                           double          max_area,
+                           CDCircleEx*     out,
+                           int             out_cap) {
+        const int    bw = s->maxx - s->minx + 3;
+        const int    bh = s->maxy - s->miny + 3;
+        const size_t n  = (size_t)bw * bh;
+        int*         dt = (int*)buffer_reserve(&ctx->split_map, 3 * n * sizeof(int));
+        if (!dt) return 0;
+        int* region = dt + n;
+        int* next   = region + n;
 
-        for (int i = 0; i < num_components; ++i) {
-                stats[i].minx = width;
-                stats[i].miny = height;
-                stats[i].maxx = -1;
-                stats[i].maxy = -1;
-                stats[i].area = 0;
-                stats[i].sumx = 0;
-                stats[i].sumy = 0;
-                stats[i].seen = 0;
+        // Padded by one background pixel on every side.
+        const int ox = s->minx - 1;
+        const int oy = s->miny - 1;
+        for (int j = 0; j < bh; ++j) {
+                for (int i = 0; i < bw; ++i) {
+                        const size_t at     = (size_t)(oy + j) * cfg->width + ox + i;
+                        const int    inside = i > 0 && j > 0 && i < bw - 1 && j < bh - 1 &&
+                                           label_at(labels, cfg->label_format, at) == label;
+                        dt[(size_t)j * bw + i]     = inside ? INT_MAX / 2 : 0;
+                        region[(size_t)j * bw + i] = inside ? 0 : -1;
+                }
+        }
+        int max_dt = 0;
+        for (int j = 1; j < bh - 1; ++j) {
+                for (int i = 1; i < bw - 1; ++i) {
+                        int* d = &dt[(size_t)j * bw + i];
+                        if (!*d) continue;
+                        int v = d[-1] + 3;
+                        if (d[-bw - 1] + 4 < v) v = d[-bw - 1] + 4;
+                        if (d[-bw] + 3 < v) v = d[-bw] + 3;
+                        if (d[-bw + 1] + 4 < v) v = d[-bw + 1] + 4;
+                        if (v < *d) *d = v;
+                }
+        }
+        for (int j = bh - 2; j > 0; --j) {
+                for (int i = bw - 2; i > 0; --i) {
+                        int* d = &dt[(size_t)j * bw + i];
+                        if (!*d) continue;
+                        int v = d[1] + 3;
+                        if (d[bw + 1] + 4 < v) v = d[bw + 1] + 4;
+                        if (d[bw] + 3 < v) v = d[bw] + 3;
+                        if (d[bw - 1] + 4 < v) v = d[bw - 1] + 4;
+                        if (v < *d) *d = v;
+                        if (*d > max_dt) max_dt = *d;
+                }
         }
 
+        int* heads = (int*)buffer_reserve(&ctx->split_heads, ((size_t)max_dt + 1) * sizeof(int));
+        if (!heads) return 0;
+        for (int l = 0; l <= max_dt; ++l) heads[l] = -1;
 
-        for (int y = 0; y < height; ++y) {
-                const int* restrict row = labels + y * width;
-                for (int x = 0; x < width; ++x) {
-                        const int lbl = row[x];
-                        if (lbl <= 0 || lbl >= num_components) continue;
-                        BoxStats* s = &stats[lbl];
-                        s->seen     = 1;
-                        if (x < s->minx) s->minx = x;
-                        if (y < s->miny) s->miny = y;
-                        if (x > s->maxx) s->maxx = x;
-                        if (y > s->maxy) s->maxy = y;
-                        s->area++;
-                        s->sumx += (uint64_t)x;
-                        s->sumy += (uint64_t)y;
+        // Local maxima of the distance, bucketed by value.
+        const int peak_min = 3 * (cfg->min_d >= 8.0 ? (int)(0.25 * cfg->min_d) : 1);
+        for (int j = 1; j < bh - 1; ++j) {
+                for (int i = 1; i < bw - 1; ++i) {
+                        const size_t p = (size_t)j * bw + i;
+                        const int    v = dt[p];
+                        if (v < peak_min) continue;
+                        if (dt[p - 1] > v || dt[p + 1] > v || dt[p - bw] > v || dt[p + bw] > v) continue;
+                        if (dt[p - bw - 1] > v || dt[p - bw + 1] > v) continue;
+                        if (dt[p + bw - 1] > v || dt[p + bw + 1] > v) continue;
+                        next[p]  = heads[v];
+                        heads[v] = (int)p;
                 }
         }
 
+        // Strongest peaks first; a peak inside the inscribed circle of an
+        // accepted seed belongs to it.
+        const int max_parts = cfg->split_touching < CD_SPLIT_MAX_PARTS ? cfg->split_touching : CD_SPLIT_MAX_PARTS;
+        int       seeds[CD_SPLIT_MAX_PARTS];
+        int       num_seeds = 0;
+        for (int l = max_dt; l >= peak_min; --l) {
+                for (int p = heads[l]; p >= 0; p = next[p]) {
+                        const int px  = p % bw;
+                        const int py  = p / bw;
+                        int       own = 0;
+                        for (int k = 0; k < num_seeds && !own; ++k) {
+                                const int dx = px - seeds[k] % bw;
+                                const int dy = py - seeds[k] / bw;
+                                own          = 9 * (dx * dx + dy * dy) < dt[seeds[k]] * dt[seeds[k]];
+                        }
+                        if (own) continue;
+                        if (num_seeds == max_parts) return 0;
+                        seeds[num_seeds++] = p;
+                }
+                heads[l] = -1;
+        }
+        if (num_seeds < 2) return 0;
+
+        // Marker watershed on the distance: always grow from the highest
+        // queued level, so regions meet along the necks between circles.
+        for (int k = 0; k < num_seeds; ++k) {
+                const int p  = seeds[k];
+                region[p]    = k + 1;
+                next[p]      = heads[dt[p]];
+                heads[dt[p]] = p;
+        }
+        static const int nb4[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+        for (int l = max_dt; l >= 0;) {
+                const int p = heads[l];
+                if (p < 0) {
+                        --l;
+                        continue;
+                }
+                heads[l] = next[p];
+                for (int k = 0; k < 4; ++k) {
+                        const int q = p + nb4[k][0] + nb4[k][1] * bw;
+                        if (region[q] != 0) continue;
+                        const int ql = dt[q] < l ? dt[q] : l;
+                        region[q]    = region[p];
+                        next[q]      = heads[ql];
+                        heads[ql]    = q;
+                }
+        }
+
+        BoxStats parts[CD_SPLIT_MAX_PARTS + 1];
+        box_stats_init(parts, num_seeds + 1, cfg->width, cfg->height);
+        for (int j = 1; j < bh - 1; ++j) {
+                const int*     row      = region + (size_t)j * bw;
+                const uint8_t* luma_row = ctx->extras.luma ? ctx->extras.luma + (size_t)(oy + j) * cfg->width : NULL;
+                for (int i = 1; i < bw - 1;) {
+                        int e = i + 1;
+                        while (e < bw - 1 && row[e] == row[i]) ++e;
+                        if (row[i] > 0) {
+                                box_stats_add_run(&parts[row[i]], oy + j, ox + i, ox + e);
+                                if (luma_row) box_stats_add_luma(&parts[row[i]], oy + j, ox + i, ox + e, luma_row);
+                        }
+                        i = e;
+                }
+        }
+        CDCircleEx found[CD_SPLIT_MAX_PARTS];
+        int        num_found = 0;
+        for (int k = 1; k <= num_seeds; ++k) {
+                parts[k].euler  = 1;
+                parts[k].strict = s->strict;
+                parts[k].cls    = s->cls;
+                CDCircleEx* e   = &found[num_found];
+                if (evaluate_component(cfg, &ctx->extras, &parts[k], label, 1, min_area, max_area, e) !=
+                    COMPONENT_ACCEPTED)
+                        continue;
+                // dt is three times the distance from the seed to the nearest
+                // background pixel centre; the edge lies half a pixel closer.
+                const double inscribed = dt[seeds[k - 1]] / 3.0 - 0.5;
+                if (fabs(e->circle.r - inscribed) > CD_SPLIT_RADIUS_TOL * inscribed) continue;
+                e->split = 1;
+                ++num_found;
+        }
+        if (num_found < 2) return 0;
+        const int written = num_found < out_cap ? num_found : out_cap;
+        memcpy(out, found, (size_t)written * sizeof(*out));
+        return written;
+}
+
+static inline int merge_find(int* parent, int l) {
+        while (parent[l] != l) {
+                parent[l] = parent[parent[l]];
+                l         = parent[l];
+        }
+        return l;
+}
+
+// Merges components whose bboxes are at most gap background pixels apart, as
+// long as the merged bbox still fits max_d. Only components that fit max_d
+// themselves take part; they are bucketed by bbox corner in a grid of cells at
+// least max_d + gap wide, so each one is compared with the 3x3 cells around
+// it. The group's stats end up in its lowest label and the other members are
+// marked unseen. Returns the per-label fragment counts, or NULL on failure.
+static const int* merge_fragments(CDContext* ctx, const CDConfig* cfg, BoxStats* stats, int num_components) {
+        const int frame  = cfg->width > cfg->height ? cfg->width : cfg->height;
+        const int gap    = cfg->merge_gap;
+        const int span   = cfg->max_d > 0.0 ? (int)ceil(cfg->max_d) : frame;
+        const int cell   = span + gap + 1;
+        const int gw     = cfg->width / cell + 1;
+        const int gh     = cfg->height / cell + 1;
+        int*      parent = (int*)buffer_reserve(&ctx->merge_links, 3 * (size_t)num_components * sizeof(int));
+        int*      head   = (int*)buffer_reserve(&ctx->merge_grid, (size_t)gw * gh * sizeof(int));
+        if (!parent || !head) return NULL;
+        int* next  = parent + num_components;
+        int* count = next + num_components;
+        for (int c = 0; c < gw * gh; ++c) head[c] = -1;
+
+        for (int a = 1; a < num_components; ++a) {
+                parent[a] = a;
+                count[a]  = 1;
+                const BoxStats* sa = &stats[a];
+                if (!sa->seen || sa->maxx - sa->minx >= span || sa->maxy - sa->miny >= span) continue;
+                const int cx = sa->minx / cell;
+                const int cy = sa->miny / cell;
+                for (int gy = cy > 0 ? cy - 1 : 0; gy <= cy + 1 && gy < gh; ++gy) {
+                        for (int gx = cx > 0 ? cx - 1 : 0; gx <= cx + 1 && gx < gw; ++gx) {
+                                for (int b = head[gy * gw + gx]; b >= 0; b = next[b]) {
+                                        const BoxStats* sb = &stats[b];
+                                        if (sb->cls != sa->cls) continue;
+                                        const int dx = sa->minx > sb->maxx ? sa->minx - sb->maxx : sb->minx - sa->maxx;
+                                        const int dy = sa->miny > sb->maxy ? sa->miny - sb->maxy : sb->miny - sa->maxy;
+                                        if (dx - 1 > gap || dy - 1 > gap) continue;
+                                        const int ra = merge_find(parent, a);
+                                        const int rb = merge_find(parent, b);
+                                        if (ra == rb) continue;
+                                        const BoxStats* ga = &stats[ra];
+                                        const BoxStats* gb = &stats[rb];
+                                        const int       x0 = ga->minx < gb->minx ? ga->minx : gb->minx;
+                                        const int       y0 = ga->miny < gb->miny ? ga->miny : gb->miny;
+                                        const int       x1 = ga->maxx > gb->maxx ? ga->maxx : gb->maxx;
+                                        const int       y1 = ga->maxy > gb->maxy ? ga->maxy : gb->maxy;
+                                        if (x1 - x0 >= span || y1 - y0 >= span) continue;
+                                        const int lo = ra < rb ? ra : rb;
+                                        const int hi = ra < rb ? rb : ra;
+                                        box_stats_merge(&stats[lo], &stats[hi]);
+                                        stats[hi].seen = 0;
+                                        count[lo] += count[hi];
+                                        parent[hi] = lo;
+                                }
+                        }
+                }
+                next[a]            = head[cy * gw + cx];
+                head[cy * gw + cx] = a;
+        }
+        return count;
+}
+
+// Region table for cfg, rebuilt only when the region fields or the polygon
+// contents changed since the last call. NULL on allocation failure.
+static const UVTable* uv_table_update(CDContext* ctx, const CDConfig* cfg) {
+        UVRegionKey key;
+        uv_region_key(cfg, &key);
+        const size_t poly_bytes = (size_t)key.polygon_count * sizeof(CDPoint);
+        const int    fresh      = ctx->uv_table.cap == 0;
+        UVTable*     t          = (UVTable*)buffer_reserve(&ctx->uv_table, sizeof(UVTable));
+        CDPoint*     poly       = (CDPoint*)buffer_reserve(&ctx->uv_polygon, poly_bytes ? poly_bytes : 1);
+        if (!t || !poly) {
+                buffer_release(&ctx->uv_table);
+                return NULL;
+        }
+        const int same = !fresh && !memcmp(&t->key, &key, sizeof(key)) &&
+                         (!poly_bytes || !memcmp(poly, cfg->uv_polygon, poly_bytes));
+        if (same) return t;
+        if (poly_bytes) memcpy(poly, cfg->uv_polygon, poly_bytes);
+        t->key = key;
+        uv_table_build(t, &key, poly);
+        return t;
+}
+
+// A dense front end whose frame width, y_min test and morphology are fixed at
+// compile time, for the cdDetectI420W* entry points.
+typedef struct {
+        int width;
+        int luma;  // y_min test compiled in
+        int morph; // open+close compiled in
+        void (*threshold)(const CDConfig* cfg, uint8_t* restrict chroma, uint8_t* restrict mask);
+        MorphRowsFn erode;
+        MorphRowsFn dilate;
+} Variant;
+
+// Shared body of the detectCircles* entry points: runs the pipeline and leaves
+// up to out_cap accepted components, sorted by area, in ctx->candidates. A
+// non-NULL variant replaces the dense threshold and morphology kernels.
+static int detect_candidates(CDContext*      ctx,
+                             const CDConfig* cfg,
+                             const Variant*  variant,
+                             int             out_cap,
+                             uint8_t*        mask,
+                             uint8_t*        tmp1,
+                             uint8_t*        tmp2,
+                             void*           labels,
+                             int*            num_components_out) {
+        const int width  = cfg->width;
+        const int height = cfg->height;
+        if (width <= 0 || height <= 0) return 0;
+        if (is_bayer(cfg->input_format) && ((width & 1) || (height & 1))) return 0;
+        const int connectivity = cfg->connectivity == 4 ? 4 : 8;
+        ctx->extras.luma       = cfg->luma_centroid ? cfg->y : NULL;
+        ctx->extras.euler      = connectivity == 8 ? 1 : 0;
+        const int hysteresis   = hysteresis_on(cfg);
+        const int morph        = cfg->morph != CD_MORPH_NONE;
+        const int num_classes  = num_color_classes(cfg);
+
+        const UVTable* uv = NULL;
+        if (cfg->uv_region != CD_UV_BOX && !num_classes) {
+                uv = uv_table_update(ctx, cfg);
+                if (!uv) return 0;
+        }
+
+        int       num_components;
+        BoxStats* stats;
+        if (cfg->pipeline == CD_PIPELINE_RUNS && !num_classes) {
+                RunImage* strict = hysteresis ? &ctx->run_strict : NULL;
+                if (!threshold_runs(ctx, cfg, uv, &ctx->run_mask, strict)) return 0;
+                if (morph && !morph_open_close_runs(ctx, &ctx->run_mask, width, height)) return 0;
+                if (morph && strict && !morph_open_close_runs(ctx, strict, width, height)) return 0;
+                num_components = label_runs(ctx, &ctx->run_mask, NULL, height, connectivity);
+                if (num_components_out) *num_components_out = num_components;
+                if (labels && cfg->label_format == CD_LABELS_UINT16 && num_components - 1 > UINT16_MAX)
+                        return CD_ERR_LABEL_OVERFLOW;
+                if (mask || labels) {
+                        paint_runs(&ctx->run_mask,
+                                   (const int*)ctx->run_labels.data,
+                                   strict,
+                                   width,
+                                   height,
+                                   mask,
+                                   labels,
+                                   cfg->label_format);
+                }
+                if (num_components <= 1) return 0;
+
+                ctx->extras.strict_mask = NULL;
+                stats = stats_from_runs(ctx, &ctx->run_mask, width, height, num_components);
+                if (!stats) return 0;
+                if (strict) mark_strict_runs(&ctx->run_mask, (const int*)ctx->run_labels.data, strict, height, stats);
+        } else {
+                if (!mask || !tmp1 || !tmp2 || !labels) return 0;
+                uint8_t* scratch = (uint8_t*)buffer_reserve(&ctx->row_scratch, threshold_scratch_bytes(width));
+                if (!scratch) return 0;
+                if (variant) {
+                        variant->threshold(cfg, scratch, mask);
+                } else {
+                        Threshold t;
+                        threshold_init(&t, cfg, uv, num_classes, scratch);
+                        for (int j = 0; j < height; ++j) threshold_row(&t, j, mask + (size_t)j * width);
+                }
+
+                if (morph) {
+                        morph_open_close_3x3(mask,
+                                             width,
+                                             height,
+                                             tmp1,
+                                             tmp2,
+                                             cfg->num_threads,
+                                             variant ? variant->erode : erode3x3_cross,
+                                             variant ? variant->dilate : dilate3x3_cross);
+                }
+                ctx->extras.strict_mask = hysteresis ? mask : NULL;
+
+                // The labeler leaves the per-label BoxStats in ctx->stats.
+                num_components =
+                    num_classes
+                        ? label_class_mask(ctx, connectivity, mask, width, height, labels, cfg->label_format)
+                        : label_mask(ctx, cfg->ccl, connectivity, mask, width, height, labels, cfg->label_format);
+                if (num_components_out) *num_components_out = num_components;
+                if (cfg->label_format == CD_LABELS_UINT16 && num_components - 1 > UINT16_MAX)
+                        return CD_ERR_LABEL_OVERFLOW;
+                if (num_components <= 1) return 0;
+                stats = (BoxStats*)ctx->stats.data;
+        }
+
         const double min_area = M_PI * (0.5 * cfg->min_d) * (0.5 * cfg->min_d);
         const double max_area = M_PI * (0.5 * cfg->max_d) * (0.5 * cfg->max_d);
 
-        int          found    = 0;
-        for (int lab = 1; lab < num_components; ++lab) {
-                const BoxStats* s = &stats[lab];
-                if (!s->seen) continue;
-                if (s->area < 4) continue;
-                const int bb_w = s->maxx - s->minx + 1;
-                const int bb_h = s->maxy - s->miny + 1;
-                if (bb_w < 2 || bb_h < 2) continue;
-                const double aspect = (double)(bb_w < bb_h ? bb_w : bb_h) / (double)(bb_w > bb_h ? bb_w : bb_h);
-                if (aspect < cfg->aspect_min) continue;
-                const double extent = (double)s->area / (double)(bb_w * bb_h);
-                if (extent < cfg->extent_min) continue;
-                const double area_full = (double)s->area;
-                if (area_full < min_area || area_full > max_area) continue;
-                const double cx_s = (double)s->sumx / (double)s->area;
-                const double cy_s = (double)s->sumy / (double)s->area;
-                CDCircle     c;
-                c.cx   = (float)(cx_s);
-                c.cy   = (float)(cy_s);
-                c.area = area_full;
-                c.r    = (float)sqrt(area_full / M_PI);
-                if (found < out_cap && found < cfg->max_out) {
-                        out[found] = c;
-                        ++found;
+        const int* fragments = NULL;
+        if (cfg->merge_gap > 0) {
+                fragments = merge_fragments(ctx, cfg, stats, num_components);
+                if (!fragments) return 0;
+        }
+
+        const int   cap        = out_cap < cfg->max_out ? out_cap : cfg->max_out;
+        CDCircleEx* candidates =
+            (CDCircleEx*)buffer_reserve(&ctx->candidates, (size_t)(cap > 0 ? cap : 1) * sizeof(CDCircleEx));
+        if (!candidates) return 0;
+
+        int found = 0;
+        for (int lab = 1; lab < num_components && found < cap; ++lab) {
+                const int verdict =
+                    evaluate_component(cfg, &ctx->extras, &stats[lab], lab, 0, min_area, max_area, &candidates[found]);
+                const int parts = fragments ? fragments[lab] : 1;
+                if (verdict == COMPONENT_ACCEPTED) {
+                        candidates[found++].fragments = parts;
+                } else if (verdict == COMPONENT_BBOX_SHAPE && cfg->split_touching > 1 && labels && parts == 1 &&
+                           stats[lab].area >= 2.0 * min_area && stats[lab].area <= cfg->split_touching * max_area) {
+                        found += split_component(
+                            ctx, cfg, labels, &stats[lab], lab, min_area, max_area, candidates + found, cap - found);
                 }
         }
 
         if (found > 1) {
-                qsort(out, (size_t)found, sizeof(CDCircle), cmp_area_desc);
+                qsort(candidates, (size_t)found, sizeof(CDCircleEx), cmp_area_desc);
+        }
+        if (cfg->refine != CD_REFINE_NONE) {
+                for (int i = 0; i < found; ++i) {
+                        // The boundary of a split circle is shared with its neighbours.
+                        if ((candidates[i].split || candidates[i].fragments > 1) && cfg->refine == CD_REFINE_BOUNDARY)
+                                continue;
+                        refine_circle(ctx,
+                                      cfg,
+                                      labels,
+                                      &stats[candidates[i].label],
+                                      candidates[i].label,
+                                      &candidates[i].circle);
+                }
+        }
+
+        // Contours only for the survivors: the cost follows their perimeters.
+        if (cfg->contour_points && cfg->contours) {
+                int used = 0;
+                for (int i = 0; i < found; ++i) {
+                        int n = 0;
+                        if (labels && !candidates[i].split && candidates[i].fragments == 1) {
+                                n = trace_contour(labels,
+                                                  cfg->label_format,
+                                                  width,
+                                                  height,
+                                                  &stats[candidates[i].label],
+                                                  candidates[i].label,
+                                                  cfg->contour_points + used,
+                                                  cfg->contour_cap - used);
+                        }
+                        cfg->contours[i].offset = used;
+                        cfg->contours[i].count  = n;
+                        used += n;
+                }
+        }
+        return found;
+}
+
+int detectCirclesCtx(CDContext*      ctx,
+                     const CDConfig* cfg,
+                     CDCircle*       out,
+                     int             out_cap,
+                     uint8_t*        mask,
+                     uint8_t*        tmp1,
+                     uint8_t*        tmp2,
+                     void*           labels,
+                     int*            num_components_out) {
+        if (!ctx || !cfg || !out || out_cap <= 0) return 0;
+        const int found = detect_candidates(ctx, cfg, NULL, out_cap, mask, tmp1, tmp2, labels, num_components_out);
+        const CDCircleEx* candidates = (const CDCircleEx*)ctx->candidates.data;
+        for (int i = 0; i < found; ++i) out[i] = candidates[i].circle;
+        return found;
+}
+
+int detectCirclesEx(CDContext*      ctx,
+                    const CDConfig* cfg,
+                    CDCircleEx*     out,
+                    int             out_cap,
+                    uint8_t*        mask,
+                    uint8_t*        tmp1,
+                    uint8_t*        tmp2,
+                    void*           labels,
+                    int*            num_components_out) {
+        if (!ctx || !cfg || !out || out_cap <= 0) return 0;
+        const int found = detect_candidates(ctx, cfg, NULL, out_cap, mask, tmp1, tmp2, labels, num_components_out);
+        if (found > 0) memcpy(out, ctx->candidates.data, (size_t)found * sizeof(CDCircleEx));
+        return found;
+}
+
+// Dense 4:2:0 box threshold of an I420 frame with the width and the y_min test
+// as literals: without the test the luma plane is never read.
+CD_KERNEL void threshold_i420_fixed(const CDConfig* cfg,
+                                    int             width,
+                                    int             luma,
+                                    uint8_t* restrict chroma,
+                                    uint8_t* restrict mask) {
+        const int     cw    = (width + 1) >> 1;
+        const uint8_t y_min = luma ? cfg->y_min : 0;
+        for (int j = 0; j < cfg->height; ++j) {
+                if (!(j & 1)) {
+                        const size_t coff = (size_t)(j >> 1) * cw;
+                        const uint8_t tol = cfg->uv_tol;
+                        box_row(cfg->u + coff, cfg->v + coff, cw, cfg->target_u, cfg->target_v, tol, tol, chroma);
+                }
+                expand_chroma_row(chroma, cfg->y + (size_t)j * width, width, 1, y_min, mask + (size_t)j * width);
         }
-        free(stats);
+}
+
+// The variant covers the call when the frame and the config are the ones it
+// was built for; anything else goes through the generic pipeline.
+static int variant_applies(const Variant* v, const CDConfig* cfg) {
+        return cfg->width == v->width && cfg->input_format == CD_INPUT_I420 && cfg->chroma_format == CD_CHROMA_420 &&
+               cfg->pipeline == CD_PIPELINE_DENSE && cfg->uv_region == CD_UV_BOX && !num_color_classes(cfg) &&
+               !hysteresis_on(cfg) && (v->luma || !cfg->y_min) && v->morph == (cfg->morph != CD_MORPH_NONE);
+}
+
+static int detect_variant(const Variant*  v,
+                          CDContext*      ctx,
+                          const CDConfig* cfg,
+                          CDCircleEx*     out,
+                          int             out_cap,
+                          uint8_t*        mask,
+                          uint8_t*        tmp1,
+                          uint8_t*        tmp2,
+                          void*           labels,
+                          int*            num_components_out) {
+        if (!ctx || !cfg || !out || out_cap <= 0) return 0;
+        const Variant* used  = variant_applies(v, cfg) ? v : NULL;
+        const int      found = detect_candidates(ctx, cfg, used, out_cap, mask, tmp1, tmp2, labels, num_components_out);
+        if (found > 0) memcpy(out, ctx->candidates.data, (size_t)found * sizeof(CDCircleEx));
         return found;
 }
+
+// Kernels of one fixed width: morphology and the threshold with and without y_min.
+#define CD_WIDTH_KERNELS(W)                                                                                            \
+        static void erode_w##W(const uint8_t* restrict src, int w, int h, int y0, int y1, uint8_t* restrict dst) {   \
+                (void)w;                                                                                               \
+                erode3x3_rows(src, W, h, y0, y1, dst);                                                                 \
+        }                                                                                                              \
+        static void dilate_w##W(const uint8_t* restrict src, int w, int h, int y0, int y1, uint8_t* restrict dst) {  \
+                (void)w;                                                                                               \
+                dilate3x3_rows(src, W, h, y0, y1, dst);                                                                \
+        }                                                                                                              \
+        static void threshold_w##W(const CDConfig* cfg, uint8_t* restrict chroma, uint8_t* restrict mask) {          \
+                threshold_i420_fixed(cfg, W, 0, chroma, mask);                                                         \
+        }                                                                                                              \
+        static void threshold_luma_w##W(const CDConfig* cfg, uint8_t* restrict chroma, uint8_t* restrict mask) {     \
+                threshold_i420_fixed(cfg, W, 1, chroma, mask);                                                         \
+        }
+
+#define CD_VARIANT(name, W, luma, morph, threshold)                                                                    \
+        int name(CDContext*      ctx,                                                                                  \
+                 const CDConfig* cfg,                                                                                  \
+                 CDCircleEx*     out,                                                                                  \
+                 int             out_cap,                                                                              \
+                 uint8_t*        mask,                                                                                 \
+                 uint8_t*        tmp1,                                                                                 \
+                 uint8_t*        tmp2,                                                                                 \
+                 void*           labels,                                                                               \
+                 int*            num_components_out) {                                                                 \
+                static const Variant v = {W, luma, morph, threshold, erode_w##W, dilate_w##W};                         \
+                return detect_variant(&v, ctx, cfg, out, out_cap, mask, tmp1, tmp2, labels, num_components_out);      \
+        }
+
+#define CD_WIDTH_VARIANTS(W)                                                                                           \
+        CD_WIDTH_KERNELS(W)                                                                                            \
+        CD_VARIANT(cdDetectI420W##W, W, 0, 0, threshold_w##W)                                                          \
+        CD_VARIANT(cdDetectI420W##W##Morph, W, 0, 1, threshold_w##W)                                                   \
+        CD_VARIANT(cdDetectI420W##W##Luma, W, 1, 0, threshold_luma_w##W)                                               \
+        CD_VARIANT(cdDetectI420W##W##LumaMorph, W, 1, 1, threshold_luma_w##W)
+
+CD_WIDTH_VARIANTS(640)
+CD_WIDTH_VARIANTS(1280)
+CD_WIDTH_VARIANTS(1920)
@@ -5,6 +5,88 @@
 extern "C" {
 #endif
 
+// Element type of the labels buffer passed to detectCirclesCtx.
+enum {
+        CD_LABELS_INT32  = 0, // width*height int
+        CD_LABELS_UINT16 = 1, // width*height uint16_t, half the label traffic
+};
+
+// Processing strategy for detectCirclesCtx.
+enum {
+        CD_PIPELINE_DENSE = 0, // full-frame mask, 3x3 morphology, Spaghetti CCL
+        CD_PIPELINE_RUNS  = 1, // per-row runs end to end, for a few blobs on an empty background
+};
+
+// Connected-component labeler for the dense pipeline. All of them produce the
+// same components and statistics; label numbering may differ.
+enum {
+        CD_CCL_SPAGHETTI = 0, // 2x2 block decision forest, best all-rounder
+        CD_CCL_SAUF      = 1, // pixel-based decision tree
+        CD_CCL_RUNS      = 2, // run-based, wins on very sparse masks
+        CD_CCL_AUTO      = 3, // pick from the run density of sampled mask rows
+};
+
+// Optional sub-pixel refinement of accepted circles (CDConfig.refine).
+enum {
+        CD_REFINE_NONE     = 0, // centre = pixel centroid, r = sqrt(area / pi)
+        CD_REFINE_BOUNDARY = 1, // least-squares fit to the traced label boundary, needs labels
+        CD_REFINE_EDGES    = 2, // least-squares fit to Y-gradient peaks along radial rays
+};
+
+// Layout of the input planes (CDConfig.input_format).
+enum {
+        CD_INPUT_I420       = 0, // y, u and v planes
+        CD_INPUT_BAYER_RGGB = 1, // raw mosaic in y (u, v unused), first row R G R G ...
+        CD_INPUT_BAYER_BGGR = 2,
+        CD_INPUT_BAYER_GRBG = 3,
+        CD_INPUT_BAYER_GBRG = 4,
+        CD_INPUT_I420_16    = 5, // y16, u16, v16 planes, samples in the low bit_depth bits (I010, I012)
+        CD_INPUT_P016       = 6, // y16 plane and interleaved UV pairs in u16, MSB-aligned (P010, P012, P016)
+};
+
+// Chroma subsampling of the u/v planes (CDConfig.chroma_format). Chroma
+// planes are ceil(width / sx) x ceil(height / sy) samples, so odd frame sizes
+// are fine; only Bayer input needs even ones.
+enum {
+        CD_CHROMA_420 = 0, // sx = 2, sy = 2
+        CD_CHROMA_422 = 1, // sx = 2, sy = 1
+        CD_CHROMA_444 = 2, // sx = 1, sy = 1
+};
+
+// Mask cleanup between thresholding and labeling (CDConfig.morph).
+enum {
+        CD_MORPH_OPEN_CLOSE = 0, // 3x3 cross open then close
+        CD_MORPH_NONE       = 1, // label the raw threshold mask
+};
+
+// Chroma decision region (CDConfig.uv_region). Everything but the box is
+// rasterised once into a 256x256 UV bitmap kept in the context.
+enum {
+        CD_UV_BOX     = 0, // |U - target_u| <= uv_tol and |V - target_v| <= uv_tol
+        CD_UV_ELLIPSE = 1, // rotated ellipse around target_u/target_v, uv_axes and uv_angle
+        CD_UV_WEDGE   = 2, // hue sector around (128, 128), uv_hue and uv_sat
+        CD_UV_POLYGON = 3, // inside uv_polygon (even-odd rule)
+};
+
+// Most colour classes one call can separate (CDConfig.classes).
+#define CD_MAX_CLASSES 8
+
+// Target colour of a multi-class call, tested like the default box.
+typedef struct {
+        uint8_t target_u;
+        uint8_t target_v;
+        uint8_t uv_tol;
+} CDColorClass;
+
+// Returned by detectCirclesCtx when CD_LABELS_UINT16 was requested but the frame
+// has more than 65535 components. num_components_out still receives the count
+// so the caller can retry with CD_LABELS_INT32; labels is left untouched.
+#define CD_ERR_LABEL_OVERFLOW (-1)
+
+// Returned by cd::Detector::detect (circleDetector.hpp) when cfg->width is not
+// the width the detector was instantiated for. Nothing is read or written.
+#define CD_ERR_WIDTH_MISMATCH (-2)
+
 typedef struct {
         float  cx;
         float  cy;
@@ -12,12 +94,60 @@ typedef struct {
         double area;
 } CDCircle;
 
+// Extended detection record returned by detectCirclesEx. Everything here comes
+// from the per-component stats, so consumers need no pass over labels.
+typedef struct {
+        CDCircle circle;
+        int      x0, y0, x1, y1; // inclusive bounding box
+        int      label;          // component id in the labels buffer
+        float    extent;         // area / bbox area
+        float    aspect;         // short / long bbox side
+        float    score;          // 0..1 confidence from roundness, aspect and fill, 1 for an ideal disc
+        int      holes;          // background regions enclosed by the component (1 for a ring)
+        int      split;          // 1 when cut out of touching circles; label is shared with the other parts
+        int      fragments;      // components merged into this circle, label is the lowest of them
+        int      color_class;    // index into CDConfig.classes, 0 without classes
+        float    eccentricity;   // from the second moments, 0 for a disc
+        float    orientation;    // major axis angle in radians
+        float    roundness;      // polar moment of a same-area disc over the component's, 1 for a disc
+} CDCircleEx;
+
+// Statistics of one labelled component, as seen by CDConfig.accept. All of it
+// comes from the stats pass; nothing has been written to out yet.
+typedef struct {
+        double area;
+        float  cx;             // pixel centroid, not luma weighted
+        float  cy;
+        int    x0, y0, x1, y1; // inclusive bounding box
+        float  aspect;         // short / long bbox side
+        float  extent;         // area / bbox area
+        int    holes;
+        int    label;
+        int    color_class;
+        int    split; // 1 for a part cut out by split_touching
+} CDComponent;
+
+// Custom acceptance rule, nonzero keeps the component.
+typedef int (*CDAcceptFn)(const CDComponent* c, void* user);
+
+// Boundary point of a traced contour, full-resolution pixel coordinates.
+typedef struct {
+        int x;
+        int y;
+} CDPoint;
+
+// Slice of CDConfig.contour_points holding the boundary of one output circle.
+typedef struct {
+        int offset;
+        int count; // 0 when the arena was full, no labels were produced or the circle was split/merged
+} CDContour;
+
 typedef struct {
         int            width;  // full-resolution width (Y plane)
         int            height; // full-resolution height (Y plane)
         const uint8_t* y;      // full-res luma
-        const uint8_t* u;      // half-res chroma U
-        const uint8_t* v;      // half-res chroma V
+        const uint8_t* u;      // chroma U, half-res unless chroma_format says otherwise
+        const uint8_t* v;      // chroma V
 
         // Target color in YUV (Y ignored by default detection logic, use y_min).
         uint8_t target_u;
@@ -30,10 +160,101 @@ typedef struct {
         double  aspect_min; // minimum aspect ratio to consider circularity
         double  extent_min; // minimum extent
         int     max_out;    // cap on number of outputs
+
+        int     num_threads;  // threads for parallel stages (0 = all cores, 1 = serial)
+        int     label_format; // CD_LABELS_INT32 (default) or CD_LABELS_UINT16, detectCirclesCtx only
+        int     pipeline;     // CD_PIPELINE_DENSE (default) or CD_PIPELINE_RUNS
+        int     ccl;          // CD_CCL_* labeler for the dense pipeline (default Spaghetti)
+        int     connectivity; // 8 (default, also 0) or 4; with 4 only CD_CCL_RUNS keeps its labeler
+
+        // Optional boundary tracing for the circles written to out. contours[i]
+        // describes out[i] (out_cap entries); the points of all contours share the
+        // contour_points arena. Needs a labels buffer. NULL disables tracing.
+        CDPoint*   contour_points;
+        int        contour_cap;
+        CDContour* contours;
+
+        int refine;        // CD_REFINE_*, applied to accepted circles only, inside their neighbourhood
+        int luma_centroid; // 1: Y-weighted centre, summed in the stats pass over foreground pixels only
+
+        double eccentricity_max; // reject more elongated components (0 to disable)
+        double roundness_min;    // reject components with a lower moment roundness (0 to disable)
+
+        int require_holes; // 1: keep only components enclosing at least one hole (rings)
+        int max_holes;     // reject components with more holes (0 = no limit, negative = solid only)
+
+        // Blobs failing only the aspect/extent tests, with an area of at most
+        // split_touching circles of max_d, are split at their distance-transform
+        // necks into up to split_touching circles. Needs labels; 0 disables.
+        int split_touching;
+
+        // Components whose bboxes are at most merge_gap background pixels apart
+        // are merged before filtering, while the merged bbox fits max_d. 0 disables.
+        int merge_gap;
+
+        // Hysteresis thresholding: uv_tol becomes the loose tolerance that grows
+        // components, and only components holding at least one pixel within
+        // uv_tol_strict survive. The mask then holds 255 for strict and 1 for
+        // loose pixels. 0 disables.
+        uint8_t uv_tol_strict;
+        int     morph; // CD_MORPH_OPEN_CLOSE (default) or CD_MORPH_NONE
+
+        // Non-box UV regions (CD_UV_*). uv_tol is unused there; with hysteresis
+        // the seeds are the region pixels that also pass the box test with
+        // uv_tol_strict (16-bit inputs: uv_tol_strict16 scaled down to 8 bits
+        // when set). The bitmap is rebuilt only when these fields, the targets
+        // or the polygon contents change between calls on a context.
+        int            uv_region;
+        float          uv_axes[2];       // CD_UV_ELLIPSE: semi-axes along and across uv_angle
+        float          uv_angle;         // CD_UV_ELLIPSE: first axis angle in radians from +U towards +V
+        float          uv_hue[2];        // CD_UV_WEDGE: atan2(V - 128, U - 128) from [0] counter-clockwise to [1]
+        float          uv_sat[2];        // CD_UV_WEDGE: chroma radius range, [1] = 0 for no upper limit
+        const CDPoint* uv_polygon;       // CD_UV_POLYGON: vertices as (x = U, y = V)
+        int            uv_polygon_count; // CD_UV_POLYGON: at least 3 vertices, else nothing matches
+
+        // Several target colours in one threshold, morphology and CCL pass. A
+        // pixel takes the first class whose box holds it and the mask holds
+        // 1 << class; components and fragment merging never cross classes.
+        // Replaces target_u/target_v/uv_tol, uv_region and hysteresis. Needs the
+        // dense buffers: pipeline and ccl are ignored, labeling goes through runs.
+        const CDColorClass* classes;
+        int                 num_classes; // up to CD_MAX_CLASSES, 0 disables
+
+        // CD_INPUT_*. For Bayer mosaics every 2x2 quad is converted to one
+        // full-range BT.601 Y/U/V sample and decided like an I420 chroma sample
+        // with its luma block, so no demosaicing is needed; y_min applies to the
+        // quad luma. Luma centroids and CD_REFINE_EDGES read the raw mosaic.
+        int input_format;
+
+        // 16-bit inputs (CD_INPUT_I420_16, CD_INPUT_P016). The box test and y_min
+        // run at full precision against the *16 fields, which are in units of
+        // bit_depth (16 for P016); with uv_tol16 = 0 the 8-bit fields are scaled
+        // up instead. UV regions and colour classes see the top 8 bits. Luma
+        // centroids and edge refinement read the 8-bit y plane if one is given.
+        const uint16_t* y16;
+        const uint16_t* u16; // CD_INPUT_P016: UV pairs, twice the chroma width per row
+        const uint16_t* v16; // CD_INPUT_I420_16 only
+        int             bit_depth;       // CD_INPUT_I420_16: 9..16, 0 = 10
+        uint16_t        target_u16;
+        uint16_t        target_v16;
+        uint16_t        uv_tol16;        // 0: use target_u/target_v/uv_tol/y_min scaled to bit_depth
+        uint16_t        uv_tol_strict16; // hysteresis seeds, 0 = uv_tol_strict scaled (or off)
+        uint16_t        y_min16;
+
+        int chroma_format; // CD_CHROMA_*, applies to the I420 and 16-bit inputs
+
+        // Replaces the aspect_min, extent_min and min_d/max_d area tests. Runs in
+        // the filtering loop before any output is written or sorted; the
+        // eccentricity, roundness, hole and hysteresis filters still apply. With
+        // split_touching a rejected component is a split candidate and its parts
+        // are offered again. NULL keeps the built-in tests.
+        CDAcceptFn accept;
+        void*      accept_user; // passed to accept
 } CDConfig;
 
 // Detect circles from an I420 buffer. Runs threshold -> morphology (3x3 open+close)
-// -> 8-connectivity CCL -> filtering. Returns number of detections written to out.
+// -> CCL (8-connectivity unless cfg->connectivity is 4) -> filtering. Returns
+// number of detections written to out.
 // Caller must provide working buffers:
 //  - mask:   width*height bytes, tightly packed.
 //  - tmp1/2: width*height bytes scratch.
@@ -47,6 +268,70 @@ int detectCircles(const CDConfig* cfg,
                   int*            labels,
                   int*            num_components_out);
 
+// Reusable workspace for detectCirclesCtx. Scratch buffers grow to the largest
+// frame seen and are kept between calls, so steady-state detection does not
+// allocate. A context must not be used by two threads at once.
+typedef struct CDContext CDContext;
+
+CDContext* cdCreateContext(void);
+void       cdDestroyContext(CDContext* ctx);
+
+// Same as detectCircles, with internal scratch taken from ctx instead of being
+// allocated per call. labels holds int or uint16_t elements depending on
+// cfg->label_format. With CD_PIPELINE_RUNS tmp1/tmp2 are unused and mask/labels
+// are optional outputs (NULL skips them, avoiding any full-frame write).
+int detectCirclesCtx(CDContext*      ctx,
+                     const CDConfig* cfg,
+                     CDCircle*       out,
+                     int             out_cap,
+                     uint8_t*        mask,
+                     uint8_t*        tmp1,
+                     uint8_t*        tmp2,
+                     void*           labels,
+                     int*            num_components_out);
+
+// detectCirclesCtx returning CDCircleEx records, in the same order.
+int detectCirclesEx(CDContext*      ctx,
+                    const CDConfig* cfg,
+                    CDCircleEx*     out,
+                    int             out_cap,
+                    uint8_t*        mask,
+                    uint8_t*        tmp1,
+                    uint8_t*        tmp2,
+                    void*           labels,
+                    int*            num_components_out);
+
+// Signature shared by detectCirclesEx and the fixed-configuration builds below.
+typedef int CDDetectFn(CDContext*      ctx,
+                       const CDConfig* cfg,
+                       CDCircleEx*     out,
+                       int             out_cap,
+                       uint8_t*        mask,
+                       uint8_t*        tmp1,
+                       uint8_t*        tmp2,
+                       void*           labels,
+                       int*            num_components_out);
+
+// Prebuilt detectCirclesEx for the dense I420 4:2:0 box threshold at a fixed
+// frame width, with the threshold and 3x3 morphology compiled for that width.
+// Luma builds test y_min, the others never read the luma plane for the mask;
+// Morph builds run the open+close, the others expect CD_MORPH_NONE. A call the
+// build does not cover (other width, input or chroma format, pipeline, UV
+// region, classes, hysteresis, y_min without Luma, morph setting) runs the
+// generic pipeline, so results never depend on which entry point was used.
+CDDetectFn cdDetectI420W640;
+CDDetectFn cdDetectI420W640Morph;
+CDDetectFn cdDetectI420W640Luma;
+CDDetectFn cdDetectI420W640LumaMorph;
+CDDetectFn cdDetectI420W1280;
+CDDetectFn cdDetectI420W1280Morph;
+CDDetectFn cdDetectI420W1280Luma;
+CDDetectFn cdDetectI420W1280LumaMorph;
+CDDetectFn cdDetectI420W1920;
+CDDetectFn cdDetectI420W1920Morph;
+CDDetectFn cdDetectI420W1920Luma;
+CDDetectFn cdDetectI420W1920LumaMorph;
+
 #ifdef __cplusplus
 }
 #endif
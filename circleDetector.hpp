@@ -0,0 +1,168 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "circleDetector.h"
+
+// C++17 front end: the pipeline settings a deployment fixes become template
+// arguments, and the matching prebuilt cdDetectI420W* entry point is chosen at
+// compile time. Combinations without a prebuilt entry use detectCirclesEx.
+// Custom acceptance rules are plain callables over CDComponent.
+namespace cd {
+
+enum class Format : int {
+        I420      = CD_INPUT_I420,
+        BayerRGGB = CD_INPUT_BAYER_RGGB,
+        BayerBGGR = CD_INPUT_BAYER_BGGR,
+        BayerGRBG = CD_INPUT_BAYER_GRBG,
+        BayerGBRG = CD_INPUT_BAYER_GBRG,
+        I420_16   = CD_INPUT_I420_16,
+        P016      = CD_INPUT_P016,
+};
+
+enum class Morph : int {
+        OpenClose = CD_MORPH_OPEN_CLOSE,
+        None      = CD_MORPH_NONE,
+};
+
+// Whether the y_min luma test is part of the threshold.
+enum class Luma : int {
+        Off,
+        On,
+};
+
+namespace detail {
+
+constexpr CDDetectFn* pick(Morph m, Luma l, CDDetectFn* plain, CDDetectFn* morph, CDDetectFn* luma, CDDetectFn* both) {
+        if (l == Luma::On) return m == Morph::OpenClose ? both : luma;
+        return m == Morph::OpenClose ? morph : plain;
+}
+
+template <Format F, Morph M, int Width, Luma L>
+constexpr CDDetectFn* select_detect() {
+        if constexpr (F != Format::I420) {
+                return &detectCirclesEx;
+        } else if constexpr (Width == 640) {
+                return pick(M, L, &cdDetectI420W640, &cdDetectI420W640Morph, &cdDetectI420W640Luma,
+                            &cdDetectI420W640LumaMorph);
+        } else if constexpr (Width == 1280) {
+                return pick(M, L, &cdDetectI420W1280, &cdDetectI420W1280Morph, &cdDetectI420W1280Luma,
+                            &cdDetectI420W1280LumaMorph);
+        } else if constexpr (Width == 1920) {
+                return pick(M, L, &cdDetectI420W1920, &cdDetectI420W1920Morph, &cdDetectI420W1920Luma,
+                            &cdDetectI420W1920LumaMorph);
+        } else {
+                return &detectCirclesEx;
+        }
+}
+
+// One trampoline per predicate type. The predicate body is inlined into this
+// trampoline only: the filter loop in circleDetector.c still makes one indirect
+// call through cfg.accept per component.
+template <class Pred>
+int accept_thunk(const CDComponent* c, void* user) {
+        return (*static_cast<Pred*>(user))(*c) ? 1 : 0;
+}
+
+} // namespace detail
+
+// Installs pred, callable as bool(const CDComponent&), as cfg.accept in place of
+// the aspect_min, extent_min and min_d/max_d tests. pred must outlive every
+// detection call made with cfg.
+template <class Pred>
+void set_accept(CDConfig& cfg, Pred& pred) {
+        static_assert(std::is_invocable_r_v<bool, Pred&, const CDComponent&>,
+                      "predicate must be callable as bool(const CDComponent&)");
+        cfg.accept      = &detail::accept_thunk<Pred>;
+        cfg.accept_user = const_cast<void*>(static_cast<const void*>(std::addressof(pred)));
+}
+
+// detectCirclesEx with pred as the acceptance rule.
+template <class Pred>
+int detect(CDContext*    ctx,
+           CDConfig      cfg,
+           Pred&&        pred,
+           CDCircleEx*   out,
+           int           out_cap,
+           std::uint8_t* mask,
+           std::uint8_t* tmp1,
+           std::uint8_t* tmp2,
+           void*         labels,
+           int*          num_components_out = nullptr) {
+        set_accept(cfg, pred);
+        return detectCirclesEx(ctx, &cfg, out, out_cap, mask, tmp1, tmp2, labels, num_components_out);
+}
+
+// Owns a CDContext, so the same rules apply: one thread at a time. Width 0
+// accepts any frame width, otherwise frames of another width are refused.
+template <Format F, int Conn, Morph M, int Width = 0, Luma L = Luma::On>
+class Detector {
+        static_assert(Conn == 4 || Conn == 8, "connectivity must be 4 or 8");
+        static_assert(Width >= 0, "width must be positive, or 0 for any");
+
+      public:
+        // True when a fixed-configuration build backs detect().
+        static constexpr bool prebuilt = detail::select_detect<F, M, Width, L>() != &detectCirclesEx;
+
+        Detector() : ctx_(cdCreateContext()) {}
+        ~Detector() { cdDestroyContext(ctx_); }
+        Detector(const Detector&)            = delete;
+        Detector& operator=(const Detector&) = delete;
+        Detector(Detector&& other) noexcept : ctx_(std::exchange(other.ctx_, nullptr)) {}
+        Detector& operator=(Detector&& other) noexcept {
+                std::swap(ctx_, other.ctx_);
+                return *this;
+        }
+
+        // False if the context could not be allocated.
+        explicit operator bool() const { return ctx_ != nullptr; }
+        CDContext* context() const { return ctx_; }
+
+        // detectCirclesEx on cfg with input_format, connectivity and morph taken
+        // from the template and y_min/y_min16 cleared for Luma::Off. Returns
+        // CD_ERR_WIDTH_MISMATCH when Width is set and cfg.width differs.
+        int detect(CDConfig      cfg,
+                   CDCircleEx*   out,
+                   int           out_cap,
+                   std::uint8_t* mask,
+                   std::uint8_t* tmp1,
+                   std::uint8_t* tmp2,
+                   void*         labels,
+                   int*          num_components_out = nullptr) {
+                if constexpr (Width != 0) {
+                        if (cfg.width != Width) return CD_ERR_WIDTH_MISMATCH;
+                }
+                cfg.input_format = static_cast<int>(F);
+                cfg.connectivity = Conn;
+                cfg.morph        = static_cast<int>(M);
+                if constexpr (L == Luma::Off) {
+                        cfg.y_min   = 0;
+                        cfg.y_min16 = 0;
+                }
+                return detect_fn(ctx_, &cfg, out, out_cap, mask, tmp1, tmp2, labels, num_components_out);
+        }
+
+        // detect() with pred as the acceptance rule, see set_accept.
+        template <class Pred, class = std::enable_if_t<std::is_invocable_r_v<bool, Pred&, const CDComponent&>>>
+        int detect(CDConfig      cfg,
+                   Pred&&        pred,
+                   CDCircleEx*   out,
+                   int           out_cap,
+                   std::uint8_t* mask,
+                   std::uint8_t* tmp1,
+                   std::uint8_t* tmp2,
+                   void*         labels,
+                   int*          num_components_out = nullptr) {
+                set_accept(cfg, pred);
+                return detect(cfg, out, out_cap, mask, tmp1, tmp2, labels, num_components_out);
+        }
+
+      private:
+        static constexpr CDDetectFn* detect_fn = detail::select_detect<F, M, Width, L>();
+
+        CDContext* ctx_;
+};
+
+} // namespace cd
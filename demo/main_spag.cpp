@@ -43,11 +43,11 @@ int main() {
         const uint8_t*          u = y + img.cols * img.rows;
         const uint8_t*          v = u + (img.cols * img.rows) / 4;
 
-        std::vector< uint8_t >  mask(img.cols * img.rows);
-        std::vector< uint8_t >  tmp1(img.cols * img.rows);
-        std::vector< uint8_t >  tmp2(img.cols * img.rows);
-        std::vector< int >      labels(img.cols * img.rows);
-        std::vector< CDCircle > detections(16);
+        std::vector< uint8_t >    mask(img.cols * img.rows);
+        std::vector< uint8_t >    tmp1(img.cols * img.rows);
+        std::vector< uint8_t >    tmp2(img.cols * img.rows);
+        std::vector< int >        labels(img.cols * img.rows);
+        std::vector< CDCircleEx > detections(16);
 
         CDConfig                cfg{};
         cfg.width                   = img.cols;
@@ -65,23 +65,26 @@ int main() {
         cfg.extent_min              = 0.50;
         cfg.max_out                 = static_cast< int >(detections.size());
 
+        CDContext*   ctx            = cdCreateContext();
         const double rss_before     = getCurrentRSS() / 1024.0;
 
         int          num_components = 0;
         auto         t0             = std::chrono::high_resolution_clock::now();
-        int          found          = detectCircles(&cfg,
-                                  detections.data(),
-                                  cfg.max_out,
-                                  mask.data(),
-                                  tmp1.data(),
-                                  tmp2.data(),
-                                  labels.data(),
-                                  &num_components);
+        int          found          = detectCirclesEx(ctx,
+                                    &cfg,
+                                    detections.data(),
+                                    cfg.max_out,
+                                    mask.data(),
+                                    tmp1.data(),
+                                    tmp2.data(),
+                                    labels.data(),
+                                    &num_components);
         auto         t1             = std::chrono::high_resolution_clock::now();
         double       ms             = std::chrono::duration< double, std::milli >(t1 - t0).count();
 
         const double rss_after      = getCurrentRSS() / 1024.0;
 
+        cdDestroyContext(ctx);
         detections.resize(found);
 
         std::cout << "C Spaghetti8 Components: " << num_components - 1 << "\n";
@@ -94,30 +97,6 @@ int main() {
                 cv::Mat mask_mat(img.rows, img.cols, CV_8UC1, mask.data());
                 cv::Mat bin = mask_mat;
                 cv::Mat vis = cv::Mat::zeros(bin.size(), CV_8UC3);
-                struct Box {
-                        int  x0, y0, x1, y1;
-                        bool seen;
-                };
-                std::vector< Box > boxes(num_components, {img.cols, img.rows, -1, -1, false});
-                for (int yb = 0; yb < img.rows; ++yb) {
-                        const int* row = labels.data() + yb * img.cols;
-                        for (int xb = 0; xb < img.cols; ++xb) {
-                                int lbl = row[xb];
-                                if (lbl <= 0 || lbl >= num_components) continue;
-                                Box& b = boxes[lbl];
-                                b.seen = true;
-                                if (xb < b.x0) b.x0 = xb;
-                                if (yb < b.y0) b.y0 = yb;
-                                if (xb > b.x1) b.x1 = xb;
-                                if (yb > b.y1) b.y1 = yb;
-                        }
-                }
-                for (int i = 1; i < num_components; ++i) {
-                        const Box& b = boxes[i];
-                        if (!b.seen) continue;
-                        cv::Rect bb(b.x0 - 2, b.y0 - 2, (b.x1 - b.x0 + 1) + 4, (b.y1 - b.y0 + 1) + 4);
-                        cv::rectangle(vis, bb, cv::Scalar(255, 255, 255), 1);
-                }
 
                 std::vector< cv::Point2f > centers;
                 std::vector< float >       radii;
@@ -126,13 +105,37 @@ int main() {
 
                 if (!detections.empty()) {
                         for (const auto& c : detections) {
-                                centers.push_back({c.cx, c.cy});
-                                radii.push_back(c.r);
+                                cv::Rect bb(c.x0 - 2, c.y0 - 2, (c.x1 - c.x0 + 1) + 4, (c.y1 - c.y0 + 1) + 4);
+                                cv::rectangle(vis, bb, cv::Scalar(255, 255, 255), 1);
+                                centers.push_back({c.circle.cx, c.circle.cy});
+                                radii.push_back(c.circle.r);
                         }
                 } else {
+                        // Nothing detected: scan the labels so every component
+                        // still gets its box and a bbox-sized circle.
+                        struct Box {
+                                int  x0, y0, x1, y1;
+                                bool seen;
+                        };
+                        std::vector< Box > boxes(num_components, {img.cols, img.rows, -1, -1, false});
+                        for (int yb = 0; yb < img.rows; ++yb) {
+                                const int* row = labels.data() + yb * img.cols;
+                                for (int xb = 0; xb < img.cols; ++xb) {
+                                        int lbl = row[xb];
+                                        if (lbl <= 0 || lbl >= num_components) continue;
+                                        Box& b = boxes[lbl];
+                                        b.seen = true;
+                                        if (xb < b.x0) b.x0 = xb;
+                                        if (yb < b.y0) b.y0 = yb;
+                                        if (xb > b.x1) b.x1 = xb;
+                                        if (yb > b.y1) b.y1 = yb;
+                                }
+                        }
                         for (int lab = 1; lab < num_components; ++lab) {
                                 const Box& b = boxes[lab];
                                 if (!b.seen) continue;
+                                cv::Rect bb(b.x0 - 2, b.y0 - 2, (b.x1 - b.x0 + 1) + 4, (b.y1 - b.y0 + 1) + 4);
+                                cv::rectangle(vis, bb, cv::Scalar(255, 255, 255), 1);
                                 float cx = 0.5f * float(b.x0 + b.x1 + 1);
                                 float cy = 0.5f * float(b.y0 + b.y1 + 1);
                                 float r  = 0.5f * std::min(b.x1 - b.x0 + 1, b.y1 - b.y0 + 1);